@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "demo/stream_spec.hpp"
+
+namespace demo {
+
+// --batch packs several records, each a complete sample with its own [msg_id][timestamp] header, into one
+// message: [magic u32][record count u32], then [size u32][record] per record. The magic lets a subscriber tell a
+// batch from a plain sample sent by a publisher without --batch.
+constexpr uint32_t kBatchMagic = 0x48435442;  // "BTCH"
+constexpr std::size_t kBatchHeaderSize = 2 * sizeof(uint32_t);
+constexpr std::size_t kBatchRecordHeaderSize = sizeof(uint32_t);
+
+// When a publisher sends its pending records: once count of them are waiting, or once the oldest has waited
+// linger_ns, whichever comes first. A linger of 0 waits for the full count.
+struct BatchSpec {
+    std::size_t count = 1;
+    int64_t linger_ns = 0;
+};
+
+// Parse "<count>[:<linger ms>]"
+inline bool parse_batch_spec(const std::string &text, BatchSpec &spec, std::string &error) {
+    std::vector<std::string> fields = split(text, ':');
+    if (fields.size() <= 2) {
+        try {
+            std::size_t used = 0;
+            long long count = std::stoll(fields[0], &used);
+            double linger_ms = fields.size() > 1 ? std::stod(fields[1]) : 0.0;
+            if (used == fields[0].size() && count >= 1 && linger_ms >= 0.0) {
+                spec.count = static_cast<std::size_t>(count);
+                spec.linger_ns = static_cast<int64_t>(linger_ms * 1e6);
+                return true;
+            }
+        } catch (const std::exception &) {
+        }
+    }
+    error = "bad batch '" + text + "', expected <records>[:<linger ms>] with at least one record";
+    return false;
+}
+
+// The pending batch of one publisher, in a buffer sized once for count records of up to max_record bytes, so
+// appending never allocates. Records are written in place by the caller.
+class BatchBuilder {
+public:
+    void init(const BatchSpec &spec, std::size_t max_record) {
+        spec_ = spec;
+        buffer_.assign(kBatchHeaderSize + spec.count * (kBatchRecordHeaderSize + max_record), 0);
+        std::memcpy(buffer_.data(), &kBatchMagic, sizeof(kBatchMagic));
+        clear();
+    }
+
+    // Room for one record of size bytes; now is when it was produced and starts the linger of an empty batch
+    uint8_t *append(std::size_t size, int64_t now) {
+        if (records_ == 0) first_ns_ = now;
+        uint32_t record_size = static_cast<uint32_t>(size);
+        std::memcpy(buffer_.data() + size_, &record_size, sizeof(record_size));
+        uint8_t *record = buffer_.data() + size_ + kBatchRecordHeaderSize;
+        size_ += kBatchRecordHeaderSize + size;
+        records_++;
+        uint32_t records = static_cast<uint32_t>(records_);
+        std::memcpy(buffer_.data() + sizeof(kBatchMagic), &records, sizeof(records));
+        return record;
+    }
+
+    bool empty() const { return records_ == 0; }
+    bool full() const { return records_ >= spec_.count; }
+    std::size_t records() const { return records_; }
+    // When the pending records must go out regardless of count; only meaningful when not empty
+    bool has_deadline() const { return spec_.linger_ns > 0 && records_ > 0; }
+    int64_t deadline_ns() const { return first_ns_ + spec_.linger_ns; }
+
+    const uint8_t *data() const { return buffer_.data(); }
+    std::size_t size() const { return size_; }
+
+    void clear() {
+        size_ = kBatchHeaderSize;
+        records_ = 0;
+    }
+
+private:
+    BatchSpec spec_;
+    std::vector<uint8_t> buffer_;
+    std::size_t size_ = kBatchHeaderSize;
+    std::size_t records_ = 0;
+    int64_t first_ns_ = 0;
+};
+
+// Call f(record, size) for every record of a batch message. False when the message is not a batch or a record
+// runs past its end; records before the bad one have been visited by then.
+template <typename F>
+bool for_each_batch_record(const uint8_t *data, std::size_t size, F &&f) {
+    if (size < kBatchHeaderSize) return false;
+    uint32_t magic, records;
+    std::memcpy(&magic, data, sizeof(magic));
+    std::memcpy(&records, data + sizeof(magic), sizeof(records));
+    if (magic != kBatchMagic) return false;
+    std::size_t offset = kBatchHeaderSize;
+    for (uint32_t i = 0; i < records; ++i) {
+        uint32_t record_size;
+        if (size - offset < kBatchRecordHeaderSize) return false;
+        std::memcpy(&record_size, data + offset, sizeof(record_size));
+        offset += kBatchRecordHeaderSize;
+        if (size - offset < record_size) return false;
+        f(data + offset, static_cast<std::size_t>(record_size));
+        offset += record_size;
+    }
+    return true;
+}
+
+}  // namespace demo
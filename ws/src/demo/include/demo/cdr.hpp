@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace demo {
+
+// Just enough XCDR1 to reach the payload of a serialized std_msgs/UInt8MultiArray without deserializing it:
+//
+//   [encapsulation: 0x00 0x01 (little endian) or 0x00 0x00 (big endian), 2 option bytes]
+//   layout.dim:         uint32 count, then per dimension: string label, uint32 size, uint32 stride
+//   layout.data_offset: uint32
+//   data:               uint32 length, then the bytes
+//
+// Alignment is relative to the end of the encapsulation header. With no dimensions the bytes start at
+// offset 16, which is what the publisher side writes.
+constexpr std::size_t kCdrEncapsulationSize = 4;
+constexpr std::size_t kCdrUInt8MultiArrayHeaderSize = kCdrEncapsulationSize + 3 * sizeof(uint32_t);
+
+class CdrReader {
+public:
+    CdrReader(const uint8_t *buffer, std::size_t length) : buffer_(buffer), length_(length) {}
+
+    bool read_encapsulation() {
+        if (length_ < kCdrEncapsulationSize || buffer_[0] != 0x00 || buffer_[1] > 0x01) return false;
+        swap_ = (buffer_[1] == 0x01) != (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__);
+        offset_ = kCdrEncapsulationSize;
+        return true;
+    }
+
+    bool read_u32(uint32_t &value) {
+        offset_ = kCdrEncapsulationSize + ((offset_ - kCdrEncapsulationSize + 3) & ~std::size_t(3));
+        if (offset_ + sizeof(uint32_t) > length_) return false;
+        memcpy(&value, buffer_ + offset_, sizeof(uint32_t));
+        if (swap_) value = __builtin_bswap32(value);
+        offset_ += sizeof(uint32_t);
+        return true;
+    }
+
+    bool skip(std::size_t bytes) {
+        if (bytes > length_ - offset_) return false;
+        offset_ += bytes;
+        return true;
+    }
+
+    std::size_t offset() const { return offset_; }
+
+private:
+    const uint8_t *buffer_;
+    std::size_t length_;
+    std::size_t offset_ = 0;
+    bool swap_ = false;
+};
+
+// Point data/size at the payload bytes inside a serialized UInt8MultiArray; false if the buffer is malformed
+inline bool cdr_uint8_multi_array_data(const uint8_t *buffer, std::size_t length, const uint8_t *&data,
+                                       std::size_t &size) {
+    CdrReader reader(buffer, length);
+    uint32_t dims, value;
+    if (!reader.read_encapsulation() || !reader.read_u32(dims)) return false;
+    for (uint32_t i = 0; i < dims; ++i) {
+        // label (length includes the NUL), size, stride
+        if (!reader.read_u32(value) || !reader.skip(value) || !reader.read_u32(value) || !reader.read_u32(value)) {
+            return false;
+        }
+    }
+    uint32_t data_length;
+    if (!reader.read_u32(value) || !reader.read_u32(data_length) || !reader.skip(data_length)) return false;
+    data = buffer + reader.offset() - data_length;
+    size = data_length;
+    return true;
+}
+
+// Write the little-endian encapsulation and an empty layout for a payload of the given size; the payload
+// itself goes at kCdrUInt8MultiArrayHeaderSize
+inline void cdr_write_uint8_multi_array_header(uint8_t *buffer, uint32_t payload) {
+    const uint8_t encapsulation[kCdrEncapsulationSize] = {0x00, 0x01, 0x00, 0x00};
+    const uint32_t fields[3] = {0, 0, payload};
+    static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "the serialized publisher writes little-endian CDR");
+    memcpy(buffer, encapsulation, sizeof(encapsulation));
+    memcpy(buffer + kCdrEncapsulationSize, fields, sizeof(fields));
+}
+
+}  // namespace demo
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "demo/crc32c.hpp"
+#include "demo/stream_spec.hpp"
+
+namespace demo {
+
+// --chunk sends every sample of a stream as fragments, each its own message: [magic u32][frame id u32]
+// [frame size u32][offset u32], then the fragment's bytes. The frame id is the sample's msg_id.
+constexpr uint32_t kChunkMagic = 0x4b4e4843;  // "CHNK"
+constexpr std::size_t kChunkHeaderSize = 4 * sizeof(uint32_t);
+// The first fragment must hold the whole sample header, checksum included
+constexpr std::size_t kMinFragmentSize = kChecksumHeaderSize;
+
+// Fragment size and pacing. A rate of 0 sends fragments as fast as the publisher gets to them; either way at
+// most burst fragments go out back to back.
+struct ChunkSpec {
+    std::size_t fragment_size = 0;
+    double rate_bytes_per_s = 0.0;
+    std::size_t burst = 1;
+};
+
+// Parse "<fragment bytes>[:<MB/s>[:<burst fragments>]]"
+inline bool parse_chunk_spec(const std::string &text, ChunkSpec &spec, std::string &error) {
+    std::vector<std::string> fields = split(text, ':');
+    if (fields.size() <= 3) {
+        try {
+            std::size_t used = 0;
+            unsigned long long fragment = std::stoull(fields[0], &used);
+            double rate_mb = fields.size() > 1 ? std::stod(fields[1]) : 0.0;
+            unsigned long long burst = fields.size() > 2 ? std::stoull(fields[2]) : 1;
+            if (used == fields[0].size() && fragment >= kMinFragmentSize && fragment <= UINT32_MAX && rate_mb >= 0.0 &&
+                burst >= 1) {
+                spec.fragment_size = static_cast<std::size_t>(fragment);
+                spec.rate_bytes_per_s = rate_mb * 1e6;
+                spec.burst = static_cast<std::size_t>(burst);
+                return true;
+            }
+        } catch (const std::exception &) {
+        }
+    }
+    error = "bad chunking '" + text + "', expected <fragment bytes>[:<MB/s>[:<burst fragments>]] with fragments of " +
+            "at least " + std::to_string(kMinFragmentSize) + " bytes";
+    return false;
+}
+
+// Byte budget refilled at rate_bytes_per_s up to capacity bytes, starting full. A rate of 0 never makes anyone
+// wait.
+class TokenBucket {
+public:
+    void init(double rate_bytes_per_s, double capacity, int64_t now_ns) {
+        rate_ = rate_bytes_per_s;
+        capacity_ = capacity;
+        tokens_ = capacity;
+        last_ns_ = now_ns;
+    }
+
+    // Spend bytes if the bucket holds them at now_ns
+    bool try_take(std::size_t bytes, int64_t now_ns) {
+        if (rate_ <= 0.0) return true;
+        refill(now_ns);
+        if (tokens_ < static_cast<double>(bytes)) return false;
+        tokens_ -= static_cast<double>(bytes);
+        return true;
+    }
+
+    // Earliest time try_take(bytes) can succeed
+    int64_t ready_ns(std::size_t bytes, int64_t now_ns) {
+        if (rate_ <= 0.0) return now_ns;
+        refill(now_ns);
+        double missing = static_cast<double>(bytes) - tokens_;
+        if (missing <= 0.0) return last_ns_;
+        return last_ns_ + static_cast<int64_t>(std::ceil(missing / rate_ * 1e9));
+    }
+
+private:
+    void refill(int64_t now_ns) {
+        if (now_ns <= last_ns_) return;
+        tokens_ = std::min(capacity_, tokens_ + (now_ns - last_ns_) * rate_ / 1e9);
+        last_ns_ = now_ns;
+    }
+
+    double rate_ = 0.0;
+    double capacity_ = 0.0;
+    double tokens_ = 0.0;
+    int64_t last_ns_ = 0;
+};
+
+// The outgoing frame of one publisher, laid out as consecutive [chunk header][fragment] slots so every fragment
+// is published straight from this buffer. init copies the stream's content in once; per frame only the chunk
+// headers and the sample header at the front of the first fragment are rewritten.
+class ChunkSender {
+public:
+    void init(const ChunkSpec &spec, const std::vector<uint8_t> &content) {
+        fragment_size_ = spec.fragment_size;
+        std::size_t slots = std::max<std::size_t>(1, (content.size() + fragment_size_ - 1) / fragment_size_);
+        buffer_.assign(slots * slot_size(), 0);
+        for (std::size_t offset = 0; offset < content.size(); offset += fragment_size_) {
+            std::memcpy(buffer_.data() + offset / fragment_size_ * slot_size() + kChunkHeaderSize,
+                        content.data() + offset, std::min(fragment_size_, content.size() - offset));
+        }
+        fragments_ = 0;
+        next_ = 0;
+    }
+
+    // Start sending a frame of the first size bytes of the content. Returns where the sample starts, for the
+    // caller to stamp its header.
+    uint8_t *begin(uint32_t frame_id, std::size_t size) {
+        size_ = size;
+        fragments_ = std::max<std::size_t>(1, (size + fragment_size_ - 1) / fragment_size_);
+        next_ = 0;
+        uint32_t fields[4] = {kChunkMagic, frame_id, static_cast<uint32_t>(size), 0};
+        for (std::size_t i = 0; i < fragments_; ++i) {
+            fields[3] = static_cast<uint32_t>(i * fragment_size_);
+            std::memcpy(buffer_.data() + i * slot_size(), fields, kChunkHeaderSize);
+        }
+        return buffer_.data() + kChunkHeaderSize;
+    }
+
+    bool sending() const { return next_ < fragments_; }
+    std::size_t fragments() const { return fragments_; }
+
+    // The next fragment message, chunk header included; only valid while sending
+    const uint8_t *next_data() const { return buffer_.data() + next_ * slot_size(); }
+    std::size_t next_size() const {
+        return kChunkHeaderSize + std::min(fragment_size_, size_ - std::min(size_, next_ * fragment_size_));
+    }
+
+    void advance() { next_++; }
+    // Drop the rest of the frame, e.g. after a failed publish
+    void cancel() { next_ = fragments_; }
+
+private:
+    std::size_t slot_size() const { return kChunkHeaderSize + fragment_size_; }
+
+    std::size_t fragment_size_ = 0;
+    std::vector<uint8_t> buffer_;
+    std::size_t size_ = 0;
+    std::size_t fragments_ = 0;
+    std::size_t next_ = 0;
+};
+
+// Rebuilds frames from in-order fragments, copying each fragment once to its place in a buffer allocated up front
+// and grown only for a frame larger than any before; a completed frame is read in place. A frame is given up,
+// and counted incomplete, when one of its fragments is missing: a gap in the offsets, another frame starting
+// early, or a frame whose first fragment never arrived.
+class Reassembler {
+public:
+    enum class Result { kPending, kComplete, kInvalid };
+
+    void init(std::size_t capacity) { buffer_.resize(capacity); }
+
+    Result add(const uint8_t *data, std::size_t size, int64_t now_ns) {
+        if (size < kChunkHeaderSize) return Result::kInvalid;
+        uint32_t fields[4];
+        std::memcpy(fields, data, kChunkHeaderSize);
+        uint32_t frame_id = fields[1], frame_size = fields[2], offset = fields[3];
+        std::size_t length = size - kChunkHeaderSize;
+        if (fields[0] != kChunkMagic || offset > frame_size || length > frame_size - offset) return Result::kInvalid;
+
+        if (offset == 0) {
+            if (active_) incomplete_++;
+            active_ = true;
+            frame_id_ = frame_id;
+            frame_size_ = frame_size;
+            received_ = 0;
+            first_ns_ = now_ns;
+            if (buffer_.size() < frame_size) buffer_.resize(frame_size);
+        } else if (!active_ || frame_id != frame_id_ || offset != received_) {
+            // Count the frame the gap broke, and once more a frame joined after its start
+            if (active_) {
+                incomplete_++;
+                active_ = false;
+                skipped_id_ = frame_id_;
+                skipping_ = true;
+            }
+            if (!skipping_ || frame_id != skipped_id_) {
+                incomplete_++;
+                skipped_id_ = frame_id;
+                skipping_ = true;
+            }
+            return Result::kPending;
+        }
+
+        if (length > 0) std::memcpy(buffer_.data() + offset, data + kChunkHeaderSize, length);
+        received_ += length;
+        if (received_ < frame_size_) return Result::kPending;
+        active_ = false;
+        return Result::kComplete;
+    }
+
+    // The last completed frame, and when its first fragment arrived
+    const uint8_t *frame() const { return buffer_.data(); }
+    std::size_t frame_size() const { return frame_size_; }
+    int64_t first_ns() const { return first_ns_; }
+
+    uint64_t incomplete() const { return incomplete_; }
+    // Give up a frame still being assembled, e.g. at the end of a run
+    void abandon() {
+        if (active_) incomplete_++;
+        active_ = false;
+    }
+
+private:
+    std::vector<uint8_t> buffer_;
+    bool active_ = false;
+    uint32_t frame_id_ = 0;
+    std::size_t frame_size_ = 0;
+    std::size_t received_ = 0;
+    int64_t first_ns_ = 0;
+    bool skipping_ = false;
+    uint32_t skipped_id_ = 0;
+    uint64_t incomplete_ = 0;
+};
+
+}  // namespace demo
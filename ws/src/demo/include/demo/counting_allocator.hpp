@@ -0,0 +1,317 @@
+#pragma once
+
+#include <malloc.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rcutils/allocator.h"
+
+namespace demo {
+
+// Allocations made while a scope is active on the calling thread, e.g. everything one rcl_publish asks for
+struct AllocationCounter {
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> bytes{0};
+};
+
+namespace detail {
+
+inline AllocationCounter *&current_allocation_scope() {
+    static thread_local AllocationCounter *scope = nullptr;
+    return scope;
+}
+
+}  // namespace detail
+
+// Attribute this thread's allocations through counting allocators to counter until the scope ends. Only the rcl
+// and rmw code that takes its allocator from init, node or entity options is seen; rosidl message init and the
+// middleware's own heap use go straight to malloc.
+class AllocationScope {
+public:
+    explicit AllocationScope(AllocationCounter *counter) : previous_(detail::current_allocation_scope()) {
+        detail::current_allocation_scope() = counter;
+    }
+    ~AllocationScope() { detail::current_allocation_scope() = previous_; }
+    AllocationScope(const AllocationScope &) = delete;
+    AllocationScope &operator=(const AllocationScope &) = delete;
+
+private:
+    AllocationCounter *previous_;
+};
+
+// Per-interval view of a scope counter: "2.0 allocs, 312 B per msg", then starts the next interval
+class AllocationRate {
+public:
+    std::string format_interval(const AllocationCounter &counter, uint64_t messages) {
+        std::string line = format(counter.allocations.load() - allocations_last_, counter.bytes.load() - bytes_last_,
+                                  messages - messages_last_);
+        allocations_last_ = counter.allocations.load();
+        bytes_last_ = counter.bytes.load();
+        messages_last_ = messages;
+        return line;
+    }
+
+    static std::string format(uint64_t allocations, uint64_t bytes, uint64_t messages) {
+        char buf[64];
+        double per_message = messages ? 1.0 / static_cast<double>(messages) : 0.0;
+        std::snprintf(buf, sizeof(buf), "%.1f allocs, %.0f B per msg", allocations * per_message, bytes * per_message);
+        return buf;
+    }
+
+private:
+    uint64_t allocations_last_ = 0;
+    uint64_t bytes_last_ = 0;
+    uint64_t messages_last_ = 0;
+};
+
+// Size-class pool behind --rcl-alloc arena. Blocks of up to kMaxBlock bytes are carved from chunks that each
+// serve one power-of-two class, and freed blocks go back on their class's free list, so a steady publish or
+// take loop reuses the same few blocks instead of going through malloc. Larger requests, and blocks that were
+// not allocated here, are passed on to malloc and free. Chunks are only released with the pool.
+class ArenaPool {
+public:
+    static constexpr std::size_t kMinBlockBits = 4;
+    static constexpr std::size_t kMaxBlockBits = 16;
+    static constexpr std::size_t kMaxBlock = std::size_t(1) << kMaxBlockBits;
+    static constexpr std::size_t kChunkSize = std::size_t(1) << 20;
+
+    ArenaPool() = default;
+    ArenaPool(const ArenaPool &) = delete;
+    ArenaPool &operator=(const ArenaPool &) = delete;
+    ~ArenaPool() {
+        for (auto &chunk : chunks_) {
+            std::free(reinterpret_cast<void *>(chunk.first));
+        }
+    }
+
+    void *allocate(std::size_t size) {
+        if (size > kMaxBlock) return std::malloc(size);
+        std::size_t cls = size_class(size);
+        std::lock_guard<std::mutex> lock(mutex_);
+        FreeBlock *block = free_[cls];
+        if (block) {
+            free_[cls] = block->next;
+            return block;
+        }
+        std::size_t block_size = std::size_t(1) << (cls + kMinBlockBits);
+        Chunk &chunk = current_[cls];
+        if (!chunk.next || chunk.next + block_size > chunk.end) {
+            void *memory = std::aligned_alloc(kChunkSize, kChunkSize);
+            if (!memory) return nullptr;
+            chunk.next = static_cast<uint8_t *>(memory);
+            chunk.end = chunk.next + kChunkSize;
+            chunks_[reinterpret_cast<uintptr_t>(memory)] = cls;
+        }
+        void *result = chunk.next;
+        chunk.next += block_size;
+        return result;
+    }
+
+    void deallocate(void *pointer) {
+        if (!pointer) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = chunks_.find(chunk_base(pointer));
+        if (it == chunks_.end()) {
+            std::free(pointer);
+            return;
+        }
+        auto *block = static_cast<FreeBlock *>(pointer);
+        block->next = free_[it->second];
+        free_[it->second] = block;
+    }
+
+    // Bytes a block can hold: its class size, or what malloc reports for blocks the pool passed on
+    std::size_t usable_size(void *pointer) {
+        if (!pointer) return 0;
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = chunks_.find(chunk_base(pointer));
+        return it == chunks_.end() ? malloc_usable_size(pointer) : std::size_t(1) << (it->second + kMinBlockBits);
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+    struct Chunk {
+        uint8_t *next = nullptr;
+        uint8_t *end = nullptr;
+    };
+    static constexpr std::size_t kClassCount = kMaxBlockBits - kMinBlockBits + 1;
+
+    static std::size_t size_class(std::size_t size) {
+        std::size_t cls = 0;
+        while ((std::size_t(1) << (cls + kMinBlockBits)) < size) {
+            cls++;
+        }
+        return cls;
+    }
+    static uintptr_t chunk_base(void *pointer) { return reinterpret_cast<uintptr_t>(pointer) & ~(kChunkSize - 1); }
+
+    std::mutex mutex_;
+    std::array<FreeBlock *, kClassCount> free_{};
+    std::array<Chunk, kClassCount> current_{};
+    // Chunk base address to size class
+    std::map<uintptr_t, std::size_t> chunks_;
+};
+
+// An rcutils allocator for one call site, e.g. the context or one topic's publisher, that counts allocations,
+// bytes and live and peak usage, optionally on top of an ArenaPool. Sizes come from malloc_usable_size or the
+// pool, so no header is added to blocks. A block freed through another site's allocator does no harm as long as
+// every site shares the same pool, or none uses one; AllocatorRegistry sees to that. rcl and the rmw may call in
+// from any thread, so the counters are atomic.
+class CountingAllocator {
+public:
+    // arena is not owned and must outlive every block handed out; null allocates from malloc
+    CountingAllocator(std::string site, ArenaPool *arena) : site_(std::move(site)), arena_(arena) {}
+    CountingAllocator(const CountingAllocator &) = delete;
+    CountingAllocator &operator=(const CountingAllocator &) = delete;
+
+    const std::string &site() const { return site_; }
+
+    rcutils_allocator_t allocator() {
+        rcutils_allocator_t allocator = rcutils_get_zero_initialized_allocator();
+        allocator.allocate = &CountingAllocator::allocate;
+        allocator.deallocate = &CountingAllocator::deallocate;
+        allocator.reallocate = &CountingAllocator::reallocate;
+        allocator.zero_allocate = &CountingAllocator::zero_allocate;
+        allocator.state = this;
+        return allocator;
+    }
+
+    // "context: 1200 allocs, 1150 frees, 12288.0 KB allocated, 96.0 KB live, 4096.0 KB peak". Live usage can dip
+    // below zero when the site frees blocks it did not allocate.
+    std::string format_summary() const {
+        char buf[256];
+        std::snprintf(buf, sizeof(buf), "%s: %llu allocs, %llu frees, %.1f KB allocated, %.1f KB live, %.1f KB peak",
+                      site_.c_str(), static_cast<unsigned long long>(allocations_.load()),
+                      static_cast<unsigned long long>(frees_.load()), bytes_.load() / 1024.0,
+                      live_.load() / 1024.0, peak_.load() / 1024.0);
+        return buf;
+    }
+
+private:
+    void *raw_allocate(std::size_t size) { return arena_ ? arena_->allocate(size) : std::malloc(size); }
+    void raw_free(void *pointer) { arena_ ? arena_->deallocate(pointer) : std::free(pointer); }
+    std::size_t usable_size(void *pointer) {
+        return arena_ ? arena_->usable_size(pointer) : malloc_usable_size(pointer);
+    }
+
+    void on_allocate(void *pointer) {
+        if (!pointer) return;
+        uint64_t size = usable_size(pointer);
+        allocations_.fetch_add(1, std::memory_order_relaxed);
+        bytes_.fetch_add(size, std::memory_order_relaxed);
+        int64_t grown = static_cast<int64_t>(size);
+        int64_t live = live_.fetch_add(grown, std::memory_order_relaxed) + grown;
+        int64_t peak = peak_.load(std::memory_order_relaxed);
+        while (live > peak && !peak_.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+        }
+        if (AllocationCounter *scope = detail::current_allocation_scope()) {
+            scope->allocations.fetch_add(1, std::memory_order_relaxed);
+            scope->bytes.fetch_add(size, std::memory_order_relaxed);
+        }
+    }
+
+    void on_free(void *pointer) {
+        if (!pointer) return;
+        frees_.fetch_add(1, std::memory_order_relaxed);
+        live_.fetch_sub(static_cast<int64_t>(usable_size(pointer)), std::memory_order_relaxed);
+    }
+
+    static void *allocate(std::size_t size, void *state) {
+        auto *self = static_cast<CountingAllocator *>(state);
+        void *pointer = self->raw_allocate(size);
+        self->on_allocate(pointer);
+        return pointer;
+    }
+
+    static void deallocate(void *pointer, void *state) {
+        auto *self = static_cast<CountingAllocator *>(state);
+        self->on_free(pointer);
+        self->raw_free(pointer);
+    }
+
+    // Counted as a free of the old block and an allocation of the new one, whether or not it moved
+    static void *reallocate(void *pointer, std::size_t size, void *state) {
+        auto *self = static_cast<CountingAllocator *>(state);
+        if (!pointer) return allocate(size, state);
+        std::size_t old_size = self->usable_size(pointer);
+        void *result;
+        if (self->arena_) {
+            if (size <= old_size) return pointer;
+            result = self->arena_->allocate(size);
+            if (!result) return nullptr;
+            std::memcpy(result, pointer, old_size);
+        } else {
+            result = std::realloc(pointer, size);
+            if (!result) return nullptr;
+        }
+        self->frees_.fetch_add(1, std::memory_order_relaxed);
+        self->live_.fetch_sub(static_cast<int64_t>(old_size), std::memory_order_relaxed);
+        if (self->arena_) self->arena_->deallocate(pointer);
+        self->on_allocate(result);
+        return result;
+    }
+
+    static void *zero_allocate(std::size_t count, std::size_t size, void *state) {
+        if (size != 0 && count > SIZE_MAX / size) return nullptr;
+        void *pointer = allocate(count * size, state);
+        if (pointer) std::memset(pointer, 0, count * size);
+        return pointer;
+    }
+
+    std::string site_;
+    ArenaPool *arena_;
+    std::atomic<uint64_t> allocations_{0};
+    std::atomic<uint64_t> frees_{0};
+    std::atomic<uint64_t> bytes_{0};
+    std::atomic<int64_t> live_{0};
+    std::atomic<int64_t> peak_{0};
+};
+
+// One CountingAllocator per call site name, created on first use. With arena set they all share one process-wide
+// ArenaPool, since rcl and the rmw free blocks through a different site's allocator than the one that made them.
+// The allocators must outlive every block they handed out, including ones rcl frees during shutdown, so the
+// registry is meant to be created once and kept for the life of the process.
+class AllocatorRegistry {
+public:
+    explicit AllocatorRegistry(bool arena) : arena_(arena ? new ArenaPool() : nullptr) {}
+
+    rcutils_allocator_t get(const std::string &site) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto &allocator : allocators_) {
+            if (allocator.site() == site) return allocator.allocator();
+        }
+        allocators_.emplace_back(site, arena_.get());
+        return allocators_.back().allocator();
+    }
+
+    std::vector<std::string> format_summary() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<std::string> lines;
+        for (const auto &allocator : allocators_) {
+            lines.push_back(allocator.format_summary());
+        }
+        return lines;
+    }
+
+private:
+    std::unique_ptr<ArenaPool> arena_;
+    std::mutex mutex_;
+    // A deque, so the allocators never move once their address has been handed out as state
+    std::deque<CountingAllocator> allocators_;
+};
+
+}  // namespace demo
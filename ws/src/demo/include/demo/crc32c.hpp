@@ -0,0 +1,176 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace demo {
+
+namespace detail {
+
+// CRC32C (Castagnoli) in the reflected bit order the SSE4.2 crc32 instruction uses
+constexpr uint32_t kCrc32cPolynomial = 0x82F63B78;
+
+// Slicing-by-8 tables: table[k][b] is the CRC of byte b followed by k zero bytes
+struct Crc32cTables {
+    uint32_t table[8][256];
+};
+
+constexpr Crc32cTables make_crc32c_tables() {
+    Crc32cTables tables{};
+    for (uint32_t b = 0; b < 256; ++b) {
+        uint32_t crc = b;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 1) ? (crc >> 1) ^ kCrc32cPolynomial : crc >> 1;
+        }
+        tables.table[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; ++b) {
+        for (int k = 1; k < 8; ++k) {
+            uint32_t previous = tables.table[k - 1][b];
+            tables.table[k][b] = (previous >> 8) ^ tables.table[0][previous & 0xFF];
+        }
+    }
+    return tables;
+}
+
+constexpr Crc32cTables kCrc32cTables = make_crc32c_tables();
+
+// The raw CRC register update, without the initial and final inversion
+inline uint32_t crc32c_software(uint32_t crc, const uint8_t *data, std::size_t size) {
+    const auto &t = kCrc32cTables.table;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint32_t low, high;
+        std::memcpy(&low, data, sizeof(low));
+        std::memcpy(&high, data + 4, sizeof(high));
+        low ^= crc;
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+              t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+    }
+    for (; size > 0; ++data, --size) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xFF];
+    }
+    return crc;
+}
+
+// a * b modulo the polynomial, both in reflected order (bit 31 is x^0)
+inline uint32_t crc32c_multiply(uint32_t a, uint32_t b) {
+    uint32_t product = 0;
+    for (uint32_t m = 1u << 31; m != 0; m >>= 1) {
+        if (a & m) product ^= b;
+        b = (b & 1) ? (b >> 1) ^ kCrc32cPolynomial : b >> 1;
+    }
+    return product;
+}
+
+// Advance a raw CRC register over size zero bytes, i.e. multiply it by x^(8 * size)
+inline uint32_t crc32c_shift(uint32_t crc, std::size_t size) {
+    uint32_t power = 1u << 23;  // x^8, one zero byte
+    for (; size != 0; size >>= 1) {
+        if (size & 1) crc = crc32c_multiply(power, crc);
+        power = crc32c_multiply(power, power);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+// The crc32 instruction has a 3 cycle latency but issues every cycle, so three independent lanes keep it busy.
+// The lanes are joined with crc32c_shift, which costs a few hundred cycles once per call.
+__attribute__((target("sse4.2"))) inline uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, std::size_t size) {
+    constexpr std::size_t kMinLane = 256;
+    if (size >= 3 * kMinLane) {
+        std::size_t lane = (size / 3) & ~std::size_t{7};
+        uint64_t c0 = crc, c1 = 0, c2 = 0;
+        for (std::size_t i = 0; i < lane; i += 8) {
+            uint64_t w0, w1, w2;
+            std::memcpy(&w0, data + i, 8);
+            std::memcpy(&w1, data + lane + i, 8);
+            std::memcpy(&w2, data + 2 * lane + i, 8);
+            c0 = _mm_crc32_u64(c0, w0);
+            c1 = _mm_crc32_u64(c1, w1);
+            c2 = _mm_crc32_u64(c2, w2);
+        }
+        crc = crc32c_shift(static_cast<uint32_t>(c0), lane) ^ static_cast<uint32_t>(c1);
+        crc = crc32c_shift(crc, lane) ^ static_cast<uint32_t>(c2);
+        data += 3 * lane;
+        size -= 3 * lane;
+    }
+    uint64_t c = crc;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, 8);
+        c = _mm_crc32_u64(c, word);
+    }
+    crc = static_cast<uint32_t>(c);
+    for (; size > 0; ++data, --size) {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+    return crc;
+}
+#endif
+
+}  // namespace detail
+
+inline bool crc32c_hardware_available() {
+#if defined(__x86_64__)
+    return __builtin_cpu_supports("sse4.2");
+#else
+    return false;
+#endif
+}
+
+// CRC32C of size bytes. Pass a previous result as crc to extend it: crc32c(b, crc32c(a)) is the CRC of a then b.
+// Uses SSE4.2 when the CPU has it and slicing-by-8 tables otherwise.
+inline uint32_t crc32c(const uint8_t *data, std::size_t size, uint32_t crc = 0) {
+#if defined(__x86_64__)
+    static const bool hardware = crc32c_hardware_available();
+    if (hardware) return ~detail::crc32c_sse42(~crc, data, size);
+#endif
+    return ~detail::crc32c_software(~crc, data, size);
+}
+
+// --checksum messages carry a CRC32C after the [msg_id][timestamp] header. It covers the bytes after it and then
+// the msg_id, so truncation, corrupted content and a body delivered under the wrong id all fail the check. The
+// timestamp is left out, which lets publishers compute the body part once per payload size.
+constexpr std::size_t kChecksumOffset = sizeof(uint32_t) + sizeof(int64_t);
+constexpr std::size_t kChecksumHeaderSize = kChecksumOffset + sizeof(uint32_t);
+
+inline uint32_t payload_body_crc(const uint8_t *data, std::size_t size) {
+    return size > kChecksumHeaderSize ? crc32c(data + kChecksumHeaderSize, size - kChecksumHeaderSize) : 0;
+}
+
+// Store the checksum of a payload whose msg_id is already written; size must be at least kChecksumHeaderSize
+inline void write_payload_checksum(uint8_t *data, uint32_t body_crc) {
+    uint32_t crc = crc32c(data, sizeof(uint32_t), body_crc);
+    std::memcpy(data + kChecksumOffset, &crc, sizeof(crc));
+}
+
+inline bool verify_payload_checksum(const uint8_t *data, std::size_t size) {
+    if (size < kChecksumHeaderSize) return false;
+    uint32_t stored;
+    std::memcpy(&stored, data + kChecksumOffset, sizeof(stored));
+    return crc32c(data, sizeof(uint32_t), payload_body_crc(data, size)) == stored;
+}
+
+// The body CRC of the last payload size a publisher sent. Streams of one size hash their payload once.
+class BodyCrcCache {
+public:
+    uint32_t get(const uint8_t *base, std::size_t size) {
+        if (size != size_) {
+            size_ = size;
+            crc_ = payload_body_crc(base, size);
+        }
+        return crc_;
+    }
+
+private:
+    std::size_t size_ = static_cast<std::size_t>(-1);
+    uint32_t crc_ = 0;
+};
+
+}  // namespace demo
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <time.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace demo {
+
+// Nanoseconds on the clock the message timestamps use. On Linux steady_clock is CLOCK_MONOTONIC,
+// which is what DeadlineSleeper sleeps on.
+inline int64_t steady_now_ns() { return std::chrono::steady_clock::now().time_since_epoch().count(); }
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Sleeps until an absolute deadline with clock_nanosleep(TIMER_ABSTIME), so oversleeping on one wakeup
+// does not push back the next one. The last spin_ns before the deadline can be busy-waited to hide the
+// kernel's wakeup latency, at the cost of a hot core. A signal ends the sleep early so the caller can
+// re-check its stop conditions.
+class DeadlineSleeper {
+public:
+    explicit DeadlineSleeper(int64_t spin_ns = 0) : spin_ns_(spin_ns) {}
+
+    void sleep_until(int64_t deadline_ns) const {
+        int64_t wake_ns = deadline_ns - spin_ns_;
+        if (wake_ns > steady_now_ns()) {
+            timespec ts;
+            ts.tv_sec = wake_ns / 1000000000;
+            ts.tv_nsec = wake_ns % 1000000000;
+            if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) return;
+        }
+        while (spin_ns_ > 0 && steady_now_ns() < deadline_ns) {
+            cpu_relax();
+        }
+    }
+
+private:
+    int64_t spin_ns_;
+};
+
+// Release times of a fixed-rate stream. Deadlines are start + n * period, derived from the start time rather
+// than from when the previous send happened, so timing errors never accumulate into rate drift. When the
+// sender falls more than a whole period behind, the missed releases are skipped and counted instead of
+// being sent back to back.
+//
+// With drift_free off, the next release is "now + period truncated to whole milliseconds", which is how
+// the publisher loop used to schedule and is kept for comparison.
+class PeriodicSchedule {
+public:
+    PeriodicSchedule() = default;
+
+    PeriodicSchedule(int64_t start_ns, double rate_hz, bool drift_free)
+        : start_ns_(start_ns), period_ns_(1e9 / rate_hz), drift_free_(drift_free), next_ns_(start_ns) {}
+
+    int64_t next_ns() const { return next_ns_; }
+    uint64_t skipped() const { return skipped_; }
+
+    // Called after the release due at next_ns() was handled at now_ns
+    void advance(int64_t now_ns) {
+        if (!drift_free_) {
+            next_ns_ = now_ns + static_cast<int64_t>(period_ns_ / 1e6) * 1000000;
+            return;
+        }
+        index_++;
+        next_ns_ = release_ns(index_);
+        if (now_ns - next_ns_ >= period_ns_) {
+            uint64_t caught_up = static_cast<uint64_t>(std::ceil((now_ns - start_ns_) / period_ns_));
+            skipped_ += caught_up - index_;
+            index_ = caught_up;
+            next_ns_ = release_ns(index_);
+        }
+    }
+
+private:
+    int64_t release_ns(uint64_t index) const { return start_ns_ + std::llround(index * period_ns_); }
+
+    int64_t start_ns_ = 0;
+    double period_ns_ = 0.0;
+    bool drift_free_ = true;
+    int64_t next_ns_ = 0;
+    uint64_t index_ = 0;
+    uint64_t skipped_ = 0;
+};
+
+}  // namespace demo
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "demo/latency_histogram.hpp"
+
+namespace demo {
+
+// Timestamps of one ping-pong exchange, NTP style: t1 publisher send and t4 publisher receive are on the
+// publisher's clock, t2 subscriber receive and t3 subscriber reply are on the subscriber's.
+struct EchoTimestamps {
+    uint32_t msg_id;
+    int64_t t1;
+    int64_t t2;
+    int64_t t3;
+};
+
+// A reply is the original [msg_id][t1] header followed by t2 and t3
+constexpr std::size_t kEchoHeaderSize = sizeof(uint32_t) + sizeof(int64_t);
+constexpr std::size_t kEchoReplySize = kEchoHeaderSize + 2 * sizeof(int64_t);
+
+inline std::string echo_topic(const std::string &topic) { return topic + "/echo"; }
+
+// Build the reply to a received message into reply, which must hold kEchoReplySize bytes.
+// Returns false when the message is too short to carry a timestamp.
+inline bool write_echo_reply(uint8_t *reply, const uint8_t *received, std::size_t size, int64_t t2, int64_t t3) {
+    if (size < kEchoHeaderSize) return false;
+    memcpy(reply, received, kEchoHeaderSize);
+    memcpy(reply + kEchoHeaderSize, &t2, sizeof(int64_t));
+    memcpy(reply + kEchoHeaderSize + sizeof(int64_t), &t3, sizeof(int64_t));
+    return true;
+}
+
+inline bool read_echo_reply(const uint8_t *data, std::size_t size, EchoTimestamps &ts) {
+    if (size < kEchoReplySize) return false;
+    memcpy(&ts.msg_id, data, sizeof(uint32_t));
+    memcpy(&ts.t1, data + sizeof(uint32_t), sizeof(int64_t));
+    memcpy(&ts.t2, data + kEchoHeaderSize, sizeof(int64_t));
+    memcpy(&ts.t3, data + kEchoHeaderSize + sizeof(int64_t), sizeof(int64_t));
+    return true;
+}
+
+// Subscriber clock minus publisher clock, NTP clock-filter style: of the last kWindow exchanges, the one with
+// the smallest round trip has the least queueing in it, so its offset is trusted.
+class ClockOffsetEstimator {
+public:
+    static constexpr std::size_t kWindow = 8;
+
+    void add(const EchoTimestamps &ts, int64_t t4) {
+        Sample &sample = samples_[next_ % kWindow];
+        sample.delay = (t4 - ts.t1) - (ts.t3 - ts.t2);
+        sample.offset = ((ts.t2 - ts.t1) + (ts.t3 - t4)) / 2;
+        next_++;
+
+        std::size_t count = next_ < kWindow ? next_ : kWindow;
+        const Sample *best = &samples_[0];
+        for (std::size_t i = 1; i < count; ++i) {
+            if (samples_[i].delay < best->delay) best = &samples_[i];
+        }
+        offset_ = best->offset;
+    }
+
+    bool valid() const { return next_ > 0; }
+    int64_t offset_ns() const { return offset_; }
+
+private:
+    struct Sample {
+        int64_t delay;
+        int64_t offset;
+    };
+    std::array<Sample, kWindow> samples_{};
+    std::size_t next_ = 0;
+    int64_t offset_ = 0;
+};
+
+// Round-trip and offset-corrected one-way latency of one stream. The interval histograms are folded into the
+// whole-run ones by format_status.
+class EchoStats {
+public:
+    void record(const EchoTimestamps &ts, int64_t t4) {
+        offset_.add(ts, t4);
+        rtt_.record((t4 - ts.t1) - (ts.t3 - ts.t2));
+        one_way_.record(ts.t2 - ts.t1 - offset_.offset_ns());
+    }
+
+    // "rtt <latency>, one-way <latency>, offset X ms", then starts the next interval
+    std::string format_status() {
+        std::string line = format(rtt_, one_way_);
+        rtt_total_.merge(rtt_);
+        one_way_total_.merge(one_way_);
+        rtt_.reset();
+        one_way_.reset();
+        return line;
+    }
+
+    std::string format_summary() {
+        rtt_total_.merge(rtt_);
+        one_way_total_.merge(one_way_);
+        rtt_.reset();
+        one_way_.reset();
+        return format(rtt_total_, one_way_total_);
+    }
+
+private:
+    std::string format(const LatencyHistogram &rtt, const LatencyHistogram &one_way) const {
+        char offset[48];
+        if (offset_.valid()) {
+            std::snprintf(offset, sizeof(offset), "%.3f ms", offset_.offset_ns() / 1e6);
+        } else {
+            std::snprintf(offset, sizeof(offset), "unknown");
+        }
+        return "rtt " + format_latency_ms(rtt) + ", one-way " + format_latency_ms(one_way) + ", offset " + offset;
+    }
+
+    ClockOffsetEstimator offset_;
+    LatencyHistogram rtt_;
+    LatencyHistogram one_way_;
+    LatencyHistogram rtt_total_;
+    LatencyHistogram one_way_total_;
+};
+
+}  // namespace demo
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <string>
+
+namespace demo {
+
+// Log-linear (HDR-style) histogram of nanosecond values with a fixed footprint.
+//
+// Values below 2^kSubBucketBits are stored exactly. Above that, every power of two is split into
+// 2^kSubBucketBits linear sub-buckets, which bounds the relative error of any reported percentile
+// to 2^-kSubBucketBits (< 1%). Recording is a few integer ops and never allocates, so it can run on
+// every message in a take loop.
+class LatencyHistogram {
+public:
+    static constexpr int kSubBucketBits = 7;
+    // Values are clamped to 2^kMaxValueBits - 1 ns (about 18 minutes)
+    static constexpr int kMaxValueBits = 40;
+    static constexpr size_t kSubBucketCount = size_t(1) << kSubBucketBits;
+    static constexpr size_t kBucketCount = size_t(kMaxValueBits - kSubBucketBits + 1) << kSubBucketBits;
+    static constexpr uint64_t kMaxValue = (uint64_t(1) << kMaxValueBits) - 1;
+
+    LatencyHistogram() { reset(); }
+
+    void reset() {
+        counts_.fill(0);
+        total_ = 0;
+        sum_ = 0.0;
+        min_ = std::numeric_limits<uint64_t>::max();
+        max_ = 0;
+    }
+
+    // Negative values (clock skew between hosts) are recorded as zero, in the mean as in the buckets
+    void record(int64_t value_ns) {
+        uint64_t value = value_ns < 0 ? 0 : std::min(static_cast<uint64_t>(value_ns), kMaxValue);
+        counts_[bucket_index(value)]++;
+        total_++;
+        sum_ += static_cast<double>(value);
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+
+    void merge(const LatencyHistogram &other) {
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+        sum_ += other.sum_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t max() const { return max_; }
+    uint64_t min() const { return total_ ? min_ : 0; }
+    double mean() const { return total_ ? sum_ / total_ : std::numeric_limits<double>::quiet_NaN(); }
+
+    // Value at the given percentile in [0, 100], reported as the midpoint of its bucket and capped by the
+    // exact maximum. Returns 0 when empty.
+    uint64_t percentile(double p) const {
+        if (total_ == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(std::ceil(p / 100.0 * total_));
+        rank = std::max<uint64_t>(1, std::min(rank, total_));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                return std::min(bucket_midpoint(i), max_);
+            }
+        }
+        return max_;
+    }
+
+    static size_t bucket_index(uint64_t value) {
+        if (value < kSubBucketCount) return static_cast<size_t>(value);
+        int exponent = 63 - __builtin_clzll(value);
+        int shift = exponent - kSubBucketBits;
+        size_t sub_bucket = static_cast<size_t>(value >> shift) - kSubBucketCount;
+        return (static_cast<size_t>(shift + 1) << kSubBucketBits) + sub_bucket;
+    }
+
+    static uint64_t bucket_midpoint(size_t index) {
+        if (index < kSubBucketCount) return index;
+        int shift = static_cast<int>(index >> kSubBucketBits) - 1;
+        uint64_t low = static_cast<uint64_t>(kSubBucketCount + (index & (kSubBucketCount - 1))) << shift;
+        return low + ((uint64_t(1) << shift) >> 1);
+    }
+
+private:
+    friend class ConcurrentLatencyHistogram;
+
+    std::array<uint64_t, kBucketCount> counts_;
+    uint64_t total_;
+    double sum_;
+    uint64_t min_;
+    uint64_t max_;
+};
+
+// Same buckets as LatencyHistogram, but recorded with relaxed atomics so another thread can drain it while
+// the owner keeps recording. Draining exchanges every field with its empty value, so each sample lands in
+// exactly one drained interval; the count and the extremes of a sample recorded mid-drain may land in
+// neighbouring intervals.
+class ConcurrentLatencyHistogram {
+public:
+    ConcurrentLatencyHistogram() {
+        for (auto &count : counts_) {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Clamped exactly as LatencyHistogram::record, so both binaries report the same mean for the same samples
+    void record(int64_t value_ns) {
+        uint64_t value = value_ns < 0 ? 0 : std::min(static_cast<uint64_t>(value_ns), LatencyHistogram::kMaxValue);
+        counts_[LatencyHistogram::bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+        uint64_t current = min_.load(std::memory_order_relaxed);
+        while (value < current && !min_.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+        current = max_.load(std::memory_order_relaxed);
+        while (value > current && !max_.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Move everything recorded so far into out
+    void drain_into(LatencyHistogram &out) {
+        for (size_t i = 0; i < LatencyHistogram::kBucketCount; ++i) {
+            if (counts_[i].load(std::memory_order_relaxed) == 0) continue;
+            uint64_t count = counts_[i].exchange(0, std::memory_order_relaxed);
+            out.counts_[i] += count;
+            out.total_ += count;
+        }
+        out.sum_ += static_cast<double>(sum_.exchange(0, std::memory_order_relaxed));
+        out.min_ = std::min(out.min_, min_.exchange(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed));
+        out.max_ = std::max(out.max_, max_.exchange(0, std::memory_order_relaxed));
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, LatencyHistogram::kBucketCount> counts_;
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> min_{std::numeric_limits<uint64_t>::max()};
+    std::atomic<uint64_t> max_{0};
+};
+
+// "6.38 ms (p50 5.10, p90 8.21, p99 12.03, p99.9 15.37, max 20.11)", or "nan ms" when empty
+inline std::string format_latency_ms(const LatencyHistogram &h) {
+    if (h.count() == 0) return "nan ms";
+    char buf[160];
+    std::snprintf(buf, sizeof(buf), "%.2f ms (p50 %.2f, p90 %.2f, p99 %.2f, p99.9 %.2f, max %.2f)", h.mean() / 1e6,
+                  h.percentile(50.0) / 1e6, h.percentile(90.0) / 1e6, h.percentile(99.0) / 1e6,
+                  h.percentile(99.9) / 1e6, h.max() / 1e6);
+    return buf;
+}
+
+}  // namespace demo
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace demo {
+
+// What the payload bytes after the [msg_id][timestamp] header contain. Compressors see the whole payload, so a
+// constant fill makes any transport compression look far better than it would on real sensor data.
+constexpr const char *kPayloadContents = "constant, random, ratio:<r> (about r:1 compressible), file:<path>";
+
+// splitmix64 of a counter: no state carried between words, so the fill loop below vectorizes
+inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+inline void fill_random(uint8_t *data, std::size_t size, uint64_t seed) {
+    std::size_t words = size / sizeof(uint64_t);
+    uint64_t key = splitmix64(seed);
+    // Word-sized stores through memcpy are one unaligned store each; the per-word hashes are independent
+    for (std::size_t i = 0; i < words; ++i) {
+        uint64_t value = splitmix64(key + i);
+        std::memcpy(data + i * sizeof(uint64_t), &value, sizeof(uint64_t));
+    }
+    uint64_t tail = splitmix64(key + words);
+    std::memcpy(data + words * sizeof(uint64_t), &tail, size % sizeof(uint64_t));
+}
+
+// Every block starts with block/ratio random bytes and is padded with the fill byte. LZ-style compressors store
+// the run for next to nothing, so the whole payload compresses to roughly 1/ratio of its size.
+inline void fill_compressible(uint8_t *data, std::size_t size, double ratio, uint8_t fill_byte, uint64_t seed) {
+    constexpr std::size_t kBlock = 4096;
+    std::size_t random_bytes = std::max<std::size_t>(1, static_cast<std::size_t>(kBlock / ratio));
+    for (std::size_t begin = 0; begin < size; begin += kBlock) {
+        std::size_t block = std::min(kBlock, size - begin);
+        std::size_t head = std::min(random_bytes, block);
+        fill_random(data + begin, head, seed + begin);
+        std::memset(data + begin + head, fill_byte, block - head);
+    }
+}
+
+// Tile the file's contents over the payload, e.g. a recorded point cloud or image
+inline bool fill_from_file(uint8_t *data, std::size_t size, const std::string &path, std::string &error) {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<uint8_t> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (!file.is_open() || contents.empty()) {
+        error = "cannot read payload file '" + path + "'";
+        return false;
+    }
+    for (std::size_t begin = 0; begin < size; begin += contents.size()) {
+        std::memcpy(data + begin, contents.data(), std::min(contents.size(), size - begin));
+    }
+    return true;
+}
+
+// Check a content spec without generating anything
+inline bool parse_payload_content(const std::string &spec, std::string &error) {
+    if (spec == "constant" || spec == "random") return true;
+    if (spec.compare(0, 6, "ratio:") == 0) {
+        try {
+            std::size_t used = 0;
+            double ratio = std::stod(spec.substr(6), &used);
+            if (used == spec.size() - 6 && ratio >= 1.0) return true;
+        } catch (const std::exception &) {
+        }
+        error = "bad compressibility in '" + spec + "', expected ratio:<r> with r >= 1";
+        return false;
+    }
+    if (spec.compare(0, 5, "file:") == 0 && spec.size() > 5) return true;
+    error = "unknown payload content '" + spec + "', expected one of " + kPayloadContents;
+    return false;
+}
+
+// Generate size bytes of content once, before publishing starts. seed keeps streams from sending identical
+// bytes, which a deduplicating or dictionary compressor could exploit across topics.
+inline bool make_payload_content(const std::string &spec, std::size_t size, uint8_t fill_byte, uint64_t seed,
+                                 std::vector<uint8_t> &out, std::string &error) {
+    if (!parse_payload_content(spec, error)) return false;
+    out.assign(size, fill_byte);
+    if (spec == "random") {
+        fill_random(out.data(), size, seed);
+    } else if (spec.compare(0, 6, "ratio:") == 0) {
+        fill_compressible(out.data(), size, std::stod(spec.substr(6)), fill_byte, seed);
+    } else if (spec.compare(0, 5, "file:") == 0) {
+        return fill_from_file(out.data(), size, spec.substr(5), error);
+    }
+    return true;
+}
+
+}  // namespace demo
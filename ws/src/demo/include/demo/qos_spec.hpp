@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "rmw/qos_profiles.h"
+#include "rmw/qos_string_conversions.h"
+
+namespace demo {
+
+constexpr const char *kQosPresets = "default|reliable|best_effort|sensor|system";
+constexpr const char *kQosSettings =
+    "reliability=reliable|best_effort, history=keep_last|keep_all, depth=<n>, durability=volatile|transient_local, "
+    "deadline=<t>, lifespan=<t>, liveliness=automatic|manual_by_topic, lease=<t>; <t> is <n>ns|us|ms|s or inf";
+
+inline bool qos_from_preset(const std::string &preset, rmw_qos_profile_t &qos) {
+    if (preset == "default" || preset == "reliable") {
+        qos = rmw_qos_profile_default;
+    } else if (preset == "best_effort") {
+        qos = rmw_qos_profile_default;
+        qos.reliability = RMW_QOS_POLICY_RELIABILITY_BEST_EFFORT;
+    } else if (preset == "sensor") {
+        qos = rmw_qos_profile_sensor_data;
+    } else if (preset == "system") {
+        qos = rmw_qos_profile_system_default;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// "50ms", "1s", "inf"; a bare number is seconds
+inline bool parse_qos_duration(const std::string &text, rmw_time_t &duration) {
+    if (text == "inf" || text == "infinite") {
+        duration = RMW_DURATION_INFINITE;
+        return true;
+    }
+    std::size_t end = 0;
+    double value;
+    try {
+        value = std::stod(text, &end);
+    } catch (const std::exception &) {
+        return false;
+    }
+    std::string unit = text.substr(end);
+    double scale_ns;
+    if (unit == "ns") {
+        scale_ns = 1.0;
+    } else if (unit == "us") {
+        scale_ns = 1e3;
+    } else if (unit == "ms") {
+        scale_ns = 1e6;
+    } else if (unit == "s" || unit.empty()) {
+        scale_ns = 1e9;
+    } else {
+        return false;
+    }
+    if (value < 0.0) return false;
+    uint64_t ns = static_cast<uint64_t>(value * scale_ns);
+    duration.sec = ns / 1000000000;
+    duration.nsec = ns % 1000000000;
+    return true;
+}
+
+// Parse "<preset>[,<key>=<value>]...", e.g. "best_effort,history=keep_last,depth=1,deadline=50ms".
+// Settings are applied on top of the preset in order.
+inline bool parse_qos(const std::string &text, rmw_qos_profile_t &qos, std::string &error) {
+    std::vector<std::string> items;
+    std::istringstream stream(text);
+    for (std::string item; std::getline(stream, item, ',');) {
+        items.push_back(item);
+    }
+    if (items.empty()) items.push_back("");
+    if (!qos_from_preset(items[0], qos)) {
+        error = "unknown QoS preset '" + items[0] + "', expected " + kQosPresets;
+        return false;
+    }
+
+    for (std::size_t i = 1; i < items.size(); ++i) {
+        std::size_t equals = items[i].find('=');
+        std::string key = items[i].substr(0, equals);
+        std::string value = equals == std::string::npos ? "" : items[i].substr(equals + 1);
+        bool ok = true;
+        if (key == "reliability") {
+            if (value == "reliable") {
+                qos.reliability = RMW_QOS_POLICY_RELIABILITY_RELIABLE;
+            } else if (value == "best_effort") {
+                qos.reliability = RMW_QOS_POLICY_RELIABILITY_BEST_EFFORT;
+            } else {
+                ok = false;
+            }
+        } else if (key == "history") {
+            if (value == "keep_last") {
+                qos.history = RMW_QOS_POLICY_HISTORY_KEEP_LAST;
+            } else if (value == "keep_all") {
+                qos.history = RMW_QOS_POLICY_HISTORY_KEEP_ALL;
+            } else {
+                ok = false;
+            }
+        } else if (key == "depth") {
+            try {
+                qos.depth = static_cast<std::size_t>(std::stoul(value));
+            } catch (const std::exception &) {
+                ok = false;
+            }
+        } else if (key == "durability") {
+            if (value == "volatile") {
+                qos.durability = RMW_QOS_POLICY_DURABILITY_VOLATILE;
+            } else if (value == "transient_local") {
+                qos.durability = RMW_QOS_POLICY_DURABILITY_TRANSIENT_LOCAL;
+            } else {
+                ok = false;
+            }
+        } else if (key == "deadline") {
+            ok = parse_qos_duration(value, qos.deadline);
+        } else if (key == "lifespan") {
+            ok = parse_qos_duration(value, qos.lifespan);
+        } else if (key == "liveliness") {
+            if (value == "automatic") {
+                qos.liveliness = RMW_QOS_POLICY_LIVELINESS_AUTOMATIC;
+            } else if (value == "manual_by_topic") {
+                qos.liveliness = RMW_QOS_POLICY_LIVELINESS_MANUAL_BY_TOPIC;
+            } else {
+                ok = false;
+            }
+        } else if (key == "lease") {
+            ok = parse_qos_duration(value, qos.liveliness_lease_duration);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            error = "bad QoS setting '" + items[i] + "', expected one of " + kQosSettings;
+            return false;
+        }
+    }
+    return true;
+}
+
+inline std::string format_qos_duration(const rmw_time_t &duration) {
+    rmw_time_t infinite = RMW_DURATION_INFINITE;
+    if (duration.sec == infinite.sec && duration.nsec == infinite.nsec) return "inf";
+    if (duration.sec == 0 && duration.nsec == 0) return "unset";
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%g ms", duration.sec * 1e3 + duration.nsec / 1e6);
+    return buf;
+}
+
+// "reliable, keep_last(10), volatile, deadline unset, lifespan unset, liveliness automatic (lease unset)"
+inline std::string format_qos(const rmw_qos_profile_t &qos) {
+    auto name = [](const char *text) { return std::string(text ? text : "unknown"); };
+    std::string history = name(rmw_qos_history_policy_to_str(qos.history));
+    if (qos.history != RMW_QOS_POLICY_HISTORY_KEEP_ALL) history += "(" + std::to_string(qos.depth) + ")";
+    return name(rmw_qos_reliability_policy_to_str(qos.reliability)) + ", " + history + ", " +
+           name(rmw_qos_durability_policy_to_str(qos.durability)) + ", deadline " + format_qos_duration(qos.deadline) +
+           ", lifespan " + format_qos_duration(qos.lifespan) + ", liveliness " +
+           name(rmw_qos_liveliness_policy_to_str(qos.liveliness)) + " (lease " +
+           format_qos_duration(qos.liveliness_lease_duration) + ")";
+}
+
+}  // namespace demo
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "demo/deadline_scheduler.hpp"
+
+namespace demo {
+
+// Cumulative resource counters of one process at one instant
+struct ResourceSample {
+    int64_t time_ns = 0;
+    double user_s = 0.0;
+    double system_s = 0.0;
+    uint64_t voluntary_switches = 0;
+    uint64_t involuntary_switches = 0;
+    uint64_t minor_faults = 0;
+    uint64_t major_faults = 0;
+    // Current, not peak, resident set
+    uint64_t rss_bytes = 0;
+};
+
+// Resident set from /proc/<pid>/statm, which unlike ru_maxrss is the current value
+inline bool read_rss(const std::string &proc_dir, uint64_t &rss_bytes) {
+    std::ifstream statm(proc_dir + "/statm");
+    uint64_t size_pages, resident_pages;
+    if (!(statm >> size_pages >> resident_pages)) return false;
+    rss_bytes = resident_pages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    return true;
+}
+
+// This process, all threads included, from getrusage
+inline bool sample_self(ResourceSample &sample) {
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return false;
+    sample.time_ns = steady_now_ns();
+    sample.user_s = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    sample.system_s = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    sample.voluntary_switches = static_cast<uint64_t>(usage.ru_nvcsw);
+    sample.involuntary_switches = static_cast<uint64_t>(usage.ru_nivcsw);
+    sample.minor_faults = static_cast<uint64_t>(usage.ru_minflt);
+    sample.major_faults = static_cast<uint64_t>(usage.ru_majflt);
+    return read_rss("/proc/self", sample.rss_bytes);
+}
+
+// Another process from /proc/<pid>/stat and /proc/<pid>/status. Fails once the process is gone.
+inline bool sample_process(pid_t pid, ResourceSample &sample) {
+    std::string dir = "/proc/" + std::to_string(pid);
+    std::ifstream stat_file(dir + "/stat");
+    std::string stat((std::istreambuf_iterator<char>(stat_file)), std::istreambuf_iterator<char>());
+    // The command name may contain spaces and parentheses, so the fields are counted from the last ')'
+    std::size_t paren = stat.rfind(')');
+    if (paren == std::string::npos) return false;
+    std::istringstream fields(stat.substr(paren + 2));
+    std::vector<std::string> field;
+    for (std::string item; fields >> item;) {
+        field.push_back(item);
+    }
+    // field[0] is stat field 3 (state); minflt is 10, majflt 12, utime 14, stime 15
+    if (field.size() < 13) return false;
+    double ticks = static_cast<double>(sysconf(_SC_CLK_TCK));
+    sample.time_ns = steady_now_ns();
+    sample.minor_faults = std::strtoull(field[7].c_str(), nullptr, 10);
+    sample.major_faults = std::strtoull(field[9].c_str(), nullptr, 10);
+    sample.user_s = std::strtoull(field[11].c_str(), nullptr, 10) / ticks;
+    sample.system_s = std::strtoull(field[12].c_str(), nullptr, 10) / ticks;
+
+    std::ifstream status(dir + "/status");
+    for (std::string line; std::getline(status, line);) {
+        if (line.compare(0, 24, "voluntary_ctxt_switches:") == 0) {
+            sample.voluntary_switches = std::strtoull(line.c_str() + 24, nullptr, 10);
+        } else if (line.compare(0, 27, "nonvoluntary_ctxt_switches:") == 0) {
+            sample.involuntary_switches = std::strtoull(line.c_str() + 27, nullptr, 10);
+        }
+    }
+    return read_rss(dir, sample.rss_bytes);
+}
+
+// First process whose command name is name, e.g. the rmw_zenohd router next to us; 0 when there is none.
+// /proc/<pid>/comm holds at most 15 characters.
+inline pid_t find_process(const std::string &name) {
+    DIR *proc = opendir("/proc");
+    if (!proc) return 0;
+    pid_t found = 0;
+    while (dirent *entry = readdir(proc)) {
+        char *end;
+        long pid = std::strtol(entry->d_name, &end, 10);
+        if (*end != '\0' || pid <= 0 || pid == getpid()) continue;
+        std::ifstream comm(std::string("/proc/") + entry->d_name + "/comm");
+        std::string command;
+        if (std::getline(comm, command) && command == name.substr(0, 15)) {
+            found = static_cast<pid_t>(pid);
+            break;
+        }
+    }
+    closedir(proc);
+    return found;
+}
+
+// Per-interval and whole-run resource use of one process. CPU is in percent of one core, so a process
+// saturating two cores reads 200%.
+class ResourceMonitor {
+public:
+    // pid 0 is this process
+    ResourceMonitor(std::string label, pid_t pid) : label_(std::move(label)), pid_(pid) {
+        valid_ = sample(first_);
+        last_ = first_;
+    }
+
+    const std::string &label() const { return label_; }
+    bool valid() const { return valid_; }
+
+    // "<label> cpu 12.5% usr + 3.0% sys, ctx 120 vol / 4 invol, faults 10 min / 0 maj, rss 45.2 MB", then starts
+    // the next interval. Reports the process as gone once it can no longer be read.
+    std::string format_interval() {
+        ResourceSample now;
+        if (!valid_) return label_ + " unavailable";
+        if (gone_ || !sample(now)) {
+            gone_ = true;
+            return label_ + " gone";
+        }
+        std::string line = format(last_, now);
+        last_ = now;
+        return line;
+    }
+
+    std::string format_summary() const {
+        if (!valid_) return label_ + " unavailable";
+        return format(first_, last_) + (gone_ ? " (average until it exited)" : " (run average, rss at end)");
+    }
+
+private:
+    bool sample(ResourceSample &out) const { return pid_ == 0 ? sample_self(out) : sample_process(pid_, out); }
+
+    std::string format(const ResourceSample &from, const ResourceSample &to) const {
+        double elapsed = (to.time_ns - from.time_ns) / 1e9;
+        double user = elapsed > 0.0 ? 100.0 * (to.user_s - from.user_s) / elapsed : 0.0;
+        double system = elapsed > 0.0 ? 100.0 * (to.system_s - from.system_s) / elapsed : 0.0;
+        char buf[256];
+        std::snprintf(buf, sizeof(buf),
+                      "%s cpu %.1f%% usr + %.1f%% sys, ctx %llu vol / %llu invol, faults %llu min / %llu maj, "
+                      "rss %.1f MB",
+                      label_.c_str(), user, system,
+                      static_cast<unsigned long long>(to.voluntary_switches - from.voluntary_switches),
+                      static_cast<unsigned long long>(to.involuntary_switches - from.involuntary_switches),
+                      static_cast<unsigned long long>(to.minor_faults - from.minor_faults),
+                      static_cast<unsigned long long>(to.major_faults - from.major_faults),
+                      to.rss_bytes / (1024.0 * 1024.0));
+        return buf;
+    }
+
+    std::string label_;
+    pid_t pid_;
+    bool valid_ = false;
+    bool gone_ = false;
+    ResourceSample first_;
+    ResourceSample last_;
+};
+
+}  // namespace demo
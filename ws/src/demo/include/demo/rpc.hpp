@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "demo/latency_histogram.hpp"
+#include "demo/stream_spec.hpp"
+
+namespace demo {
+
+constexpr const char *kRpcKinds = "add_two_ints, payload:<request bytes>[:<response bytes>]";
+
+// The service a --rpc run calls, and how hard. add_two_ints is the smallest possible call; payload uses
+// demo/srv/Payload to send and return an arbitrary number of bytes.
+struct RpcSpec {
+    std::string kind;
+    std::size_t request_size = 0;
+    std::size_t response_size = 0;
+    double rate = 10.0;
+    double timeout_s = 1.0;
+};
+
+inline bool parse_rpc_spec(const std::string &text, RpcSpec &spec, std::string &error) {
+    std::vector<std::string> fields = split(text, ':');
+    spec.kind = fields[0];
+    if (spec.kind == "add_two_ints" && fields.size() == 1) return true;
+    if (spec.kind == "payload" && fields.size() >= 2 && fields.size() <= 3) {
+        try {
+            spec.request_size = static_cast<std::size_t>(std::stoul(fields[1]));
+            spec.response_size = fields.size() > 2 ? static_cast<std::size_t>(std::stoul(fields[2])) : 0;
+            return true;
+        } catch (const std::exception &) {
+        }
+    }
+    error = "bad RPC '" + text + "', expected one of " + kRpcKinds;
+    return false;
+}
+
+inline std::string rpc_service_name(const RpcSpec &spec) { return "rpc/" + spec.kind; }
+
+inline std::string describe_rpc(const RpcSpec &spec) {
+    char buf[128];
+    if (spec.kind == "payload") {
+        std::snprintf(buf, sizeof(buf), "%s (%zu B request, %zu B response) at %.1f Hz", spec.kind.c_str(),
+                      spec.request_size, spec.response_size, spec.rate);
+    } else {
+        std::snprintf(buf, sizeof(buf), "%s at %.1f Hz", spec.kind.c_str(), spec.rate);
+    }
+    return buf;
+}
+
+// Calls in flight by sequence number, with their send time
+class PendingCalls {
+public:
+    void add(int64_t sequence, int64_t sent_ns) { sent_[sequence] = sent_ns; }
+
+    // Forget an answered call and hand back its send time; false for unknown or already expired calls
+    bool complete(int64_t sequence, int64_t &sent_ns) {
+        auto it = sent_.find(sequence);
+        if (it == sent_.end()) return false;
+        sent_ns = it->second;
+        sent_.erase(it);
+        return true;
+    }
+
+    // Drop calls sent before deadline_ns and return how many there were
+    std::size_t expire(int64_t deadline_ns) {
+        std::size_t expired = 0;
+        for (auto it = sent_.begin(); it != sent_.end();) {
+            if (it->second < deadline_ns) {
+                it = sent_.erase(it);
+                expired++;
+            } else {
+                ++it;
+            }
+        }
+        return expired;
+    }
+
+    std::size_t size() const { return sent_.size(); }
+
+private:
+    std::map<int64_t, int64_t> sent_;
+};
+
+// Round trips, timeouts and wrong answers of one client. The interval histogram is folded into the whole-run one
+// by format_status.
+class RpcStats {
+public:
+    void record(int64_t rtt_ns) {
+        calls_++;
+        rtt_.record(rtt_ns);
+    }
+    void timeout(std::size_t count = 1) { timeouts_ += count; }
+    void bad_reply() { bad_replies_++; }
+
+    // "12 calls, rtt <latency>, 0 timeouts, 0 bad replies", then starts the next interval
+    std::string format_status() {
+        std::string line = format(calls_ - calls_last_, rtt_, timeouts_ - timeouts_last_,
+                                  bad_replies_ - bad_replies_last_);
+        rtt_total_.merge(rtt_);
+        rtt_.reset();
+        calls_last_ = calls_;
+        timeouts_last_ = timeouts_;
+        bad_replies_last_ = bad_replies_;
+        return line;
+    }
+
+    std::string format_summary() {
+        rtt_total_.merge(rtt_);
+        rtt_.reset();
+        return format(calls_, rtt_total_, timeouts_, bad_replies_);
+    }
+
+private:
+    static std::string format(uint64_t calls, const LatencyHistogram &rtt, uint64_t timeouts, uint64_t bad_replies) {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), ", %llu timeouts, %llu bad replies", static_cast<unsigned long long>(timeouts),
+                      static_cast<unsigned long long>(bad_replies));
+        return std::to_string(calls) + " calls, rtt " + format_latency_ms(rtt) + buf;
+    }
+
+    uint64_t calls_ = 0;
+    uint64_t calls_last_ = 0;
+    uint64_t timeouts_ = 0;
+    uint64_t timeouts_last_ = 0;
+    uint64_t bad_replies_ = 0;
+    uint64_t bad_replies_last_ = 0;
+    LatencyHistogram rtt_;
+    LatencyHistogram rtt_total_;
+};
+
+}  // namespace demo
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace demo {
+
+// Cumulative sequence counters of one stream. Subtracting an earlier snapshot yields the counters of
+// that interval.
+struct SequenceStats {
+    uint64_t received = 0;    // every sample carrying an id, duplicates and late ones included
+    uint64_t expected = 0;    // ids spanned from the first to the highest one seen
+    uint64_t unique = 0;      // distinct ids that arrived while still inside the reorder window
+    uint64_t reordered = 0;   // arrived after a higher id, but inside the window
+    uint64_t duplicates = 0;  // same id seen again inside the window
+    uint64_t late = 0;        // arrived after leaving the window, so it stays counted as lost
+    uint64_t resyncs = 0;     // publisher restarts detected
+
+    // A reordered sample can fill a hole of an earlier interval, so an interval may see more unique
+    // ids than new expected ones; that is reported as no loss rather than negative loss.
+    uint64_t lost() const { return expected > unique ? expected - unique : 0; }
+
+    double loss_percent() const { return expected == 0 ? 0.0 : static_cast<double>(lost()) / expected * 100.0; }
+
+    SequenceStats operator-(const SequenceStats &earlier) const {
+        SequenceStats d;
+        d.received = received - earlier.received;
+        d.expected = expected - earlier.expected;
+        d.unique = unique - earlier.unique;
+        d.reordered = reordered - earlier.reordered;
+        d.duplicates = duplicates - earlier.duplicates;
+        d.late = late - earlier.late;
+        d.resyncs = resyncs - earlier.resyncs;
+        return d;
+    }
+};
+
+// Loss accounting over uint32 message ids with a sliding bitmap of the last kWindow ids.
+//
+// Ids are compared with serial-number arithmetic, so wrapping from 0xFFFFFFFF to 0 is just the next
+// id. A gap counts every skipped id as missing immediately; an id that later fills the gap while still
+// inside the window is counted as reordered and stops being missing. Ids older than the window are
+// late and remain lost. The publisher restarted when id 0, the first id every publisher sends, comes back
+// after it was already recorded and the stream is at least kResyncAfter ids past it, or when kResyncAfter
+// consecutive ids are late. A first id 0 that is merely delayed is an ordinary reorder. Either
+// way the tracker rebases on the new ids instead of reporting them as duplicates, reorders or late. A restart
+// whose id 0 is lost before the old highest id is kWindow behind still goes unnoticed.
+class SequenceTracker {
+public:
+    static constexpr uint32_t kWindow = 1024;
+    static constexpr uint32_t kResyncAfter = 8;
+
+    void record(uint32_t id) {
+        stats_.received++;
+        if (!started_) {
+            rebase(id);
+            return;
+        }
+
+        int32_t diff = static_cast<int32_t>(id - highest_);
+        if (diff > 0) {
+            consecutive_late_ = 0;
+            advance(id, static_cast<uint32_t>(diff));
+        } else if (diff == 0) {
+            consecutive_late_ = 0;
+            stats_.duplicates++;
+        } else if (id == 0 && seen_zero_ && -static_cast<int64_t>(diff) >= kResyncAfter) {
+            stats_.resyncs++;
+            rebase(id);
+        } else if (static_cast<uint32_t>(-static_cast<int64_t>(diff)) >= kWindow) {
+            stats_.late++;
+            if (++consecutive_late_ >= kResyncAfter) {
+                stats_.resyncs++;
+                rebase(id);
+            }
+        } else if (test(id)) {
+            consecutive_late_ = 0;
+            stats_.duplicates++;
+        } else {
+            consecutive_late_ = 0;
+            set(id);
+            stats_.unique++;
+            stats_.reordered++;
+        }
+    }
+
+    const SequenceStats &stats() const { return stats_; }
+
+private:
+    void rebase(uint32_t id) {
+        started_ = true;
+        consecutive_late_ = 0;
+        seen_zero_ = false;
+        bits_.fill(0);
+        highest_ = id;
+        set(id);
+        stats_.expected++;
+        stats_.unique++;
+    }
+
+    void advance(uint32_t id, uint32_t distance) {
+        if (distance >= kWindow) {
+            bits_.fill(0);
+        } else {
+            for (uint32_t k = 1; k <= distance; ++k) {
+                clear(highest_ + k);
+            }
+        }
+        highest_ = id;
+        set(id);
+        stats_.expected += distance;
+        stats_.unique++;
+    }
+
+    bool test(uint32_t id) const { return bits_[(id % kWindow) / 64] & (uint64_t(1) << (id % 64)); }
+    void set(uint32_t id) {
+        bits_[(id % kWindow) / 64] |= uint64_t(1) << (id % 64);
+        if (id == 0) seen_zero_ = true;
+    }
+    void clear(uint32_t id) { bits_[(id % kWindow) / 64] &= ~(uint64_t(1) << (id % 64)); }
+
+    std::array<uint64_t, kWindow / 64> bits_{};
+    uint32_t highest_ = 0;
+    uint32_t consecutive_late_ = 0;
+    // Id 0 was recorded since the last rebase, so seeing it again means a restart
+    bool seen_zero_ = false;
+    bool started_ = false;
+    SequenceStats stats_;
+};
+
+// SequenceStats published by the thread that records ids and read by another one without locks. Fields are
+// stored one at a time, so a reader can see some fields one sample ahead of others; that only shifts a sample
+// between neighbouring intervals.
+class AtomicSequenceStats {
+public:
+    void store(const SequenceStats &stats) {
+        received_.store(stats.received, std::memory_order_relaxed);
+        expected_.store(stats.expected, std::memory_order_relaxed);
+        unique_.store(stats.unique, std::memory_order_relaxed);
+        reordered_.store(stats.reordered, std::memory_order_relaxed);
+        duplicates_.store(stats.duplicates, std::memory_order_relaxed);
+        late_.store(stats.late, std::memory_order_relaxed);
+        resyncs_.store(stats.resyncs, std::memory_order_relaxed);
+    }
+
+    SequenceStats load() const {
+        SequenceStats stats;
+        stats.received = received_.load(std::memory_order_relaxed);
+        stats.expected = expected_.load(std::memory_order_relaxed);
+        stats.unique = unique_.load(std::memory_order_relaxed);
+        stats.reordered = reordered_.load(std::memory_order_relaxed);
+        stats.duplicates = duplicates_.load(std::memory_order_relaxed);
+        stats.late = late_.load(std::memory_order_relaxed);
+        stats.resyncs = resyncs_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    std::atomic<uint64_t> received_{0};
+    std::atomic<uint64_t> expected_{0};
+    std::atomic<uint64_t> unique_{0};
+    std::atomic<uint64_t> reordered_{0};
+    std::atomic<uint64_t> duplicates_{0};
+    std::atomic<uint64_t> late_{0};
+    std::atomic<uint64_t> resyncs_{0};
+};
+
+// "loss: 1.17% (12 lost, 0 reordered, 0 dup, 0 late)" for one interval
+inline std::string format_loss(const SequenceStats &interval) {
+    char buf[160];
+    std::snprintf(buf, sizeof(buf), "loss: %.2f%% (%llu lost, %llu reordered, %llu dup, %llu late)",
+                  interval.loss_percent(), static_cast<unsigned long long>(interval.lost()),
+                  static_cast<unsigned long long>(interval.reordered),
+                  static_cast<unsigned long long>(interval.duplicates), static_cast<unsigned long long>(interval.late));
+    return buf;
+}
+
+}  // namespace demo
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "demo/latency_histogram.hpp"
+
+namespace demo {
+
+constexpr std::size_t kCacheLineSize = 64;
+
+// Subscriber counters written by one executor thread. Aligned and padded to whole cache lines so two
+// threads never write to the same line.
+struct alignas(kCacheLineSize) StatsShard {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> payload_size{0};
+    ConcurrentLatencyHistogram latency;
+};
+
+// Per-thread shards of one stream's subscriber statistics. Callbacks update the shard of the thread they run
+// on with relaxed atomics, so the hot path neither locks nor bounces cache lines between cores; the status
+// timer sums the shards without stopping the writers. Threads beyond the shard count share shards, which
+// stays correct because every update is an atomic read-modify-write.
+class ShardedStats {
+public:
+    explicit ShardedStats(std::size_t shards) : shards_(std::max<std::size_t>(shards, 1)) {}
+
+    StatsShard &local() { return shards_[thread_slot() % shards_.size()]; }
+
+    uint64_t count() const {
+        uint64_t total = 0;
+        for (const auto &shard : shards_) {
+            total += shard.count.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    // Largest payload any thread saw last
+    uint64_t payload_size() const {
+        uint64_t size = 0;
+        for (const auto &shard : shards_) {
+            size = std::max(size, shard.payload_size.load(std::memory_order_relaxed));
+        }
+        return size;
+    }
+
+    // Move the latencies recorded since the previous call into out
+    void drain_latency(LatencyHistogram &out) {
+        for (auto &shard : shards_) {
+            shard.latency.drain_into(out);
+        }
+    }
+
+private:
+    // Stable small index per thread, handed out on first use
+    static std::size_t thread_slot() {
+        static std::atomic<std::size_t> next_slot{0};
+        thread_local std::size_t slot = next_slot.fetch_add(1, std::memory_order_relaxed);
+        return slot;
+    }
+
+    std::vector<StatsShard> shards_;
+};
+
+}  // namespace demo
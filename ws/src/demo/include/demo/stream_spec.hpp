@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "demo/qos_spec.hpp"
+
+namespace demo {
+
+// One topic stream as given on the command line. Subscribers only use the name and QoS, plus the payload size
+// for --chunk streams, which sizes their reassembly buffer.
+struct StreamSpec {
+    std::string name;
+    double rate = 1.0;
+    std::size_t payload = 0;
+    // Preset plus optional settings, see parse_qos
+    std::string qos = "default";
+    // Arrival process, see traffic_profile.hpp
+    std::string traffic = "constant";
+    // Payload bytes, see payload_content.hpp
+    std::string content = "constant";
+    // Records per message and linger, see batch.hpp; empty sends one sample per message
+    std::string batch;
+    // Fragment size and pacing, see chunking.hpp; empty sends every sample whole
+    std::string chunk;
+    uint8_t fill_byte = 0xA1;
+};
+
+// Keeps the historical 0xA1/0xB2 bytes for the first two streams and stays distinct after that
+inline uint8_t default_fill_byte(std::size_t index) { return static_cast<uint8_t>(0xA1 + 0x11 * index); }
+
+inline std::vector<std::string> split(const std::string &text, char delimiter) {
+    std::vector<std::string> fields;
+    std::size_t begin = 0;
+    while (true) {
+        std::size_t end = text.find(delimiter, begin);
+        fields.push_back(text.substr(begin, end == std::string::npos ? std::string::npos : end - begin));
+        if (end == std::string::npos) break;
+        begin = end + 1;
+    }
+    return fields;
+}
+
+// Parse "name[:rate[:payload[:qos]]]", e.g. "camera:30:1048576:sensor,depth=1". Omitted fields keep the
+// StreamSpec defaults, which is all a subscriber needs except for --chunk streams, which need the payload too.
+inline bool parse_stream_spec(const std::string &text, StreamSpec &spec, std::string &error) {
+    std::vector<std::string> fields = split(text, ':');
+    if (fields.size() > 4 || fields[0].empty()) {
+        error = "expected <name>[:<Hz>[:<bytes>[:<qos>]]], got '" + text + "'";
+        return false;
+    }
+    spec.name = fields[0];
+    try {
+        if (fields.size() > 1) spec.rate = std::stod(fields[1]);
+        if (fields.size() > 2) spec.payload = static_cast<std::size_t>(std::stoul(fields[2]));
+    } catch (const std::exception &) {
+        error = "bad number in '" + text + "'";
+        return false;
+    }
+    if (spec.rate <= 0.0) {
+        error = "rate must be positive in '" + text + "'";
+        return false;
+    }
+    if (fields.size() > 3) spec.qos = fields[3];
+    rmw_qos_profile_t qos;
+    return parse_qos(spec.qos, qos, error);
+}
+
+// Resolve the QoS of a stream whose spec was already validated
+inline rmw_qos_profile_t stream_qos_profile(const StreamSpec &spec) {
+    rmw_qos_profile_t qos = rmw_qos_profile_default;
+    std::string error;
+    parse_qos(spec.qos, qos, error);
+    return qos;
+}
+
+// Find the stream a "<name>:<value>" option refers to and split off the value
+inline StreamSpec *find_stream_option(std::vector<StreamSpec> &streams, const std::string &text, std::string &value) {
+    std::size_t colon = text.find(':');
+    if (colon == std::string::npos) return nullptr;
+    for (auto &spec : streams) {
+        if (spec.name == text.substr(0, colon)) {
+            value = text.substr(colon + 1);
+            return &spec;
+        }
+    }
+    return nullptr;
+}
+
+// Assign fill bytes by position and reject streams that share a topic name
+inline bool finalize_streams(std::vector<StreamSpec> &streams, std::string &error) {
+    for (std::size_t i = 0; i < streams.size(); ++i) {
+        streams[i].fill_byte = default_fill_byte(i);
+        for (std::size_t j = 0; j < i; ++j) {
+            if (streams[j].name == streams[i].name) {
+                error = "stream '" + streams[i].name + "' given twice";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+}  // namespace demo
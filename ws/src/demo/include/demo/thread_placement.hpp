@@ -0,0 +1,117 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace demo {
+
+// Where a benchmark thread runs: the CPUs it may use and its SCHED_FIFO priority. The defaults leave the
+// thread as the kernel created it.
+struct ThreadPlacement {
+    std::vector<int> cpus;
+    // 1..99 switches to SCHED_FIFO, 0 keeps SCHED_OTHER
+    int priority = 0;
+};
+
+// Parse a taskset-style list, e.g. "1,3" or "0-2,6"
+inline bool parse_cpu_list(const std::string &text, std::vector<int> &cpus, std::string &error) {
+    cpus.clear();
+    std::size_t begin = 0;
+    while (true) {
+        std::size_t end = text.find(',', begin);
+        std::string item = text.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+        std::size_t dash = item.find('-');
+        int first, last;
+        try {
+            std::size_t used = 0;
+            first = std::stoi(item, &used);
+            if (used != (dash == std::string::npos ? item.size() : dash)) throw std::invalid_argument(item);
+            last = first;
+            if (dash != std::string::npos) {
+                std::string upper = item.substr(dash + 1);
+                last = std::stoi(upper, &used);
+                if (used != upper.size()) throw std::invalid_argument(item);
+            }
+        } catch (const std::exception &) {
+            error = "bad CPU list '" + text + "', expected e.g. 1,3 or 0-2";
+            return false;
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE) {
+            error = "bad CPU range '" + item + "'";
+            return false;
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+        if (end == std::string::npos) break;
+        begin = end + 1;
+    }
+    return true;
+}
+
+inline bool parse_rt_priority(const std::string &text, int &priority, std::string &error) {
+    try {
+        std::size_t used = 0;
+        priority = std::stoi(text, &used);
+        if (used == text.size() && priority >= 0 && priority <= 99) return true;
+    } catch (const std::exception &) {
+    }
+    error = "bad priority '" + text + "', expected 0 (SCHED_OTHER) or 1-99 (SCHED_FIFO)";
+    return false;
+}
+
+// "cpus 1,3, SCHED_FIFO 80" or "unpinned, SCHED_OTHER"
+inline std::string describe_placement(const ThreadPlacement &placement) {
+    std::string cpus;
+    for (int cpu : placement.cpus) {
+        cpus += (cpus.empty() ? "" : ",") + std::to_string(cpu);
+    }
+    return (cpus.empty() ? std::string("unpinned") : "cpus " + cpus) + ", " +
+           (placement.priority ? "SCHED_FIFO " + std::to_string(placement.priority) : std::string("SCHED_OTHER"));
+}
+
+// Apply a placement to the calling thread. Threads it creates afterwards inherit it. SCHED_FIFO needs
+// CAP_SYS_NICE or an RLIMIT_RTPRIO allowance, e.g. cap_add: SYS_NICE in docker-compose.
+inline bool apply_thread_placement(const ThreadPlacement &placement, std::string &error) {
+    if (!placement.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : placement.cpus) {
+            CPU_SET(cpu, &set);
+        }
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (rc != 0) {
+            error = std::string("pthread_setaffinity_np: ") + strerror(rc);
+            return false;
+        }
+    }
+    if (placement.priority > 0) {
+        sched_param param{};
+        param.sched_priority = placement.priority;
+        int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (rc != 0) {
+            error = std::string("pthread_setschedparam(SCHED_FIFO): ") + strerror(rc);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Lock current and future pages so page faults cannot land on the measured path. Needs CAP_IPC_LOCK or a
+// large enough RLIMIT_MEMLOCK.
+inline bool lock_all_memory(std::string &error) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        error = std::string("mlockall: ") + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+}  // namespace demo
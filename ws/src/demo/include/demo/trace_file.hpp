@@ -0,0 +1,186 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace demo {
+
+// One message as seen by a publisher (recv_ns is 0, duration is the publish call) or a subscriber
+// (duration is the rcl_take call). Timestamps are steady_clock nanoseconds.
+struct TraceRecord {
+    uint32_t stream;
+    uint32_t msg_id;
+    int64_t send_ns;
+    int64_t recv_ns;
+    uint32_t size;
+    uint32_t reserved;
+    int64_t duration_ns;
+};
+static_assert(sizeof(TraceRecord) == 40, "trace records are written to disk as-is");
+
+constexpr char kTraceMagic[8] = {'Q', 'O', 'S', 'T', 'R', 'A', 'C', 'E'};
+constexpr uint32_t kTraceVersion = 1;
+// The header owns the first page; records start right after it so they stay page aligned
+constexpr std::size_t kTraceHeaderSize = 4096;
+
+// File layout: this header, NUL-separated stream names up to kTraceHeaderSize, then a ring of capacity records.
+// write_index counts every record ever written, so the ring holds the last min(write_index, capacity) of them.
+struct TraceFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;
+    uint64_t write_index;
+    char role[8];
+    uint32_t stream_count;
+    uint32_t names_size;
+};
+
+// Appends records to a memory-mapped ring file. Recording is a slot reservation plus a 40 byte copy into
+// memory that was faulted in at open, so it never blocks on I/O; the kernel writes the pages back on its own.
+// record() may be called from several threads at once.
+class TraceWriter {
+public:
+    TraceWriter() = default;
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter &operator=(const TraceWriter &) = delete;
+    ~TraceWriter() { close(); }
+
+    bool open(const std::string &path, uint64_t capacity, const std::string &role,
+              const std::vector<std::string> &stream_names, std::string &error) {
+        close();
+        std::string names;
+        for (const auto &name : stream_names) {
+            names += name;
+            names.push_back('\0');
+        }
+        if (sizeof(TraceFileHeader) + names.size() > kTraceHeaderSize) {
+            error = "stream names do not fit in the trace header";
+            return false;
+        }
+
+        size_ = kTraceHeaderSize + capacity * sizeof(TraceRecord);
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || ftruncate(fd, static_cast<off_t>(size_)) != 0) {
+            error = "cannot create '" + path + "': " + std::strerror(errno);
+            if (fd >= 0) ::close(fd);
+            return false;
+        }
+        void *map = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            error = "cannot map '" + path + "': " + std::strerror(errno);
+            return false;
+        }
+
+        base_ = static_cast<uint8_t *>(map);
+        header_ = reinterpret_cast<TraceFileHeader *>(base_);
+        records_ = reinterpret_cast<TraceRecord *>(base_ + kTraceHeaderSize);
+        memcpy(header_->magic, kTraceMagic, sizeof(kTraceMagic));
+        header_->version = kTraceVersion;
+        header_->record_size = sizeof(TraceRecord);
+        header_->capacity = capacity;
+        header_->write_index = 0;
+        strncpy(header_->role, role.c_str(), sizeof(header_->role) - 1);
+        header_->stream_count = static_cast<uint32_t>(stream_names.size());
+        header_->names_size = static_cast<uint32_t>(names.size());
+        memcpy(base_ + sizeof(TraceFileHeader), names.data(), names.size());
+        return true;
+    }
+
+    bool is_open() const { return base_ != nullptr; }
+
+    void record(const TraceRecord &record) {
+        uint64_t slot = __atomic_fetch_add(&header_->write_index, 1, __ATOMIC_RELAXED);
+        records_[slot % header_->capacity] = record;
+    }
+
+    uint64_t written() const { return base_ ? __atomic_load_n(&header_->write_index, __ATOMIC_RELAXED) : 0; }
+    uint64_t capacity() const { return base_ ? header_->capacity : 0; }
+
+    void close() {
+        if (!base_) return;
+        munmap(base_, size_);
+        base_ = nullptr;
+        header_ = nullptr;
+        records_ = nullptr;
+    }
+
+private:
+    uint8_t *base_ = nullptr;
+    std::size_t size_ = 0;
+    TraceFileHeader *header_ = nullptr;
+    TraceRecord *records_ = nullptr;
+};
+
+// Read-only view of a trace file, with records in the order they were written
+class TraceReader {
+public:
+    TraceReader() = default;
+    TraceReader(const TraceReader &) = delete;
+    TraceReader &operator=(const TraceReader &) = delete;
+    ~TraceReader() {
+        if (base_) munmap(base_, size_);
+    }
+
+    bool open(const std::string &path, std::string &error) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            error = "cannot open '" + path + "': " + std::strerror(errno);
+            if (fd >= 0) ::close(fd);
+            return false;
+        }
+        size_ = static_cast<std::size_t>(st.st_size);
+        void *map = size_ >= kTraceHeaderSize ? mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            error = "cannot map '" + path + "'";
+            return false;
+        }
+        base_ = static_cast<uint8_t *>(map);
+        header_ = reinterpret_cast<const TraceFileHeader *>(base_);
+        if (memcmp(header_->magic, kTraceMagic, sizeof(kTraceMagic)) != 0 || header_->version != kTraceVersion ||
+            header_->record_size != sizeof(TraceRecord) ||
+            size_ < kTraceHeaderSize + header_->capacity * sizeof(TraceRecord) ||
+            sizeof(TraceFileHeader) + header_->names_size > kTraceHeaderSize) {
+            error = "'" + path + "' is not a version " + std::to_string(kTraceVersion) + " trace";
+            return false;
+        }
+        records_ = reinterpret_cast<const TraceRecord *>(base_ + kTraceHeaderSize);
+
+        const char *names = reinterpret_cast<const char *>(base_ + sizeof(TraceFileHeader));
+        for (uint32_t offset = 0; offset < header_->names_size; offset += names_.back().size() + 1) {
+            names_.emplace_back(names + offset);
+        }
+        return true;
+    }
+
+    std::string role() const { return std::string(header_->role, strnlen(header_->role, sizeof(header_->role))); }
+    const std::vector<std::string> &stream_names() const { return names_; }
+    uint64_t written() const { return header_->write_index; }
+    uint64_t size() const { return written() < header_->capacity ? written() : header_->capacity; }
+
+    // i-th oldest record still in the ring
+    const TraceRecord &at(uint64_t i) const {
+        uint64_t first = written() - size();
+        return records_[(first + i) % header_->capacity];
+    }
+
+private:
+    uint8_t *base_ = nullptr;
+    std::size_t size_ = 0;
+    const TraceFileHeader *header_ = nullptr;
+    const TraceRecord *records_ = nullptr;
+    std::vector<std::string> names_;
+};
+
+}  // namespace demo
@@ -0,0 +1,304 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "demo/deadline_scheduler.hpp"
+#include "demo/stream_spec.hpp"
+
+namespace demo {
+
+// When and how large the next samples of a stream are. Release times are absolute, so a late send never
+// shifts the releases after it.
+class ArrivalProcess {
+public:
+    virtual ~ArrivalProcess() = default;
+
+    virtual void start(int64_t start_ns) = 0;
+    // Called after the release due at next_ns() was handled at now_ns
+    virtual void advance(int64_t now_ns) = 0;
+    virtual std::size_t max_size() const = 0;
+    virtual std::string describe() const = 0;
+    virtual uint64_t skipped() const { return 0; }
+
+    int64_t next_ns() const { return next_ns_; }
+    std::size_t next_size() const { return next_size_; }
+    // A trace that does not loop has no more releases
+    bool exhausted() const { return exhausted_; }
+
+protected:
+    int64_t next_ns_ = 0;
+    std::size_t next_size_ = 0;
+    bool exhausted_ = false;
+};
+
+// Fixed rate on a PeriodicSchedule, including its skip-when-behind and legacy behaviour
+class ConstantArrivals : public ArrivalProcess {
+public:
+    ConstantArrivals(double rate, std::size_t payload, bool drift_free)
+        : rate_(rate), drift_free_(drift_free) {
+        next_size_ = payload;
+    }
+
+    void start(int64_t start_ns) override {
+        schedule_ = PeriodicSchedule(start_ns, rate_, drift_free_);
+        next_ns_ = schedule_.next_ns();
+    }
+
+    void advance(int64_t now_ns) override {
+        schedule_.advance(now_ns);
+        next_ns_ = schedule_.next_ns();
+    }
+
+    std::size_t max_size() const override { return next_size_; }
+    uint64_t skipped() const override { return schedule_.skipped(); }
+
+    std::string describe() const override {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "constant %.1f Hz", rate_);
+        return buf;
+    }
+
+private:
+    double rate_;
+    bool drift_free_;
+    PeriodicSchedule schedule_;
+};
+
+// Exponentially distributed gaps with the given mean rate
+class PoissonArrivals : public ArrivalProcess {
+public:
+    PoissonArrivals(double rate, std::size_t payload, uint64_t seed) : rate_(rate), rng_(seed), gap_s_(rate) {
+        next_size_ = payload;
+    }
+
+    void start(int64_t start_ns) override { next_ns_ = start_ns + draw_gap_ns(); }
+    void advance(int64_t) override { next_ns_ += draw_gap_ns(); }
+    std::size_t max_size() const override { return next_size_; }
+
+    std::string describe() const override {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "poisson %.1f Hz", rate_);
+        return buf;
+    }
+
+private:
+    int64_t draw_gap_ns() { return static_cast<int64_t>(gap_s_(rng_) * 1e9); }
+
+    double rate_;
+    std::mt19937_64 rng_;
+    std::exponential_distribution<double> gap_s_;
+};
+
+// Sends at the stream rate for duty * period seconds, then stays silent for the rest of the period
+class OnOffArrivals : public ArrivalProcess {
+public:
+    OnOffArrivals(double rate, std::size_t payload, double duty, double period_s)
+        : rate_(rate), duty_(duty), period_s_(period_s), period_ns_(period_s * 1e9), gap_ns_(1e9 / rate),
+          on_ns_(duty * period_s * 1e9) {
+        next_size_ = payload;
+    }
+
+    void start(int64_t start_ns) override {
+        cycle_start_ns_ = start_ns;
+        index_ = 0;
+        next_ns_ = start_ns;
+    }
+
+    void advance(int64_t) override {
+        index_++;
+        if (index_ * gap_ns_ >= on_ns_) {
+            cycle_start_ns_ += static_cast<int64_t>(period_ns_);
+            index_ = 0;
+        }
+        next_ns_ = cycle_start_ns_ + static_cast<int64_t>(index_ * gap_ns_);
+    }
+
+    std::size_t max_size() const override { return next_size_; }
+
+    std::string describe() const override {
+        char buf[96];
+        std::snprintf(buf, sizeof(buf), "on/off %.1f Hz for %.0f%% of %.2f s", rate_, duty_ * 100.0, period_s_);
+        return buf;
+    }
+
+private:
+    double rate_;
+    double duty_;
+    double period_s_;
+    double period_ns_;
+    double gap_ns_;
+    double on_ns_;
+    int64_t cycle_start_ns_ = 0;
+    uint64_t index_ = 0;
+};
+
+// Replays recorded (gap, size) pairs; the gap of an entry is the time since the previous release
+class TraceArrivals : public ArrivalProcess {
+public:
+    struct Entry {
+        int64_t gap_ns;
+        std::size_t size;
+    };
+
+    TraceArrivals(std::string path, std::vector<Entry> entries, bool loop)
+        : path_(std::move(path)), entries_(std::move(entries)), loop_(loop) {
+        for (const auto &entry : entries_) {
+            max_size_ = std::max(max_size_, entry.size);
+        }
+    }
+
+    void start(int64_t start_ns) override {
+        index_ = 0;
+        next_ns_ = start_ns + entries_[0].gap_ns;
+        next_size_ = entries_[0].size;
+    }
+
+    void advance(int64_t) override {
+        if (++index_ == entries_.size()) {
+            if (!loop_) {
+                exhausted_ = true;
+                return;
+            }
+            index_ = 0;
+        }
+        next_ns_ += entries_[index_].gap_ns;
+        next_size_ = entries_[index_].size;
+    }
+
+    std::size_t max_size() const override { return max_size_; }
+
+    std::string describe() const override {
+        return "trace " + path_ + " (" + std::to_string(entries_.size()) + " arrivals" + (loop_ ? ", looped)" : ")");
+    }
+
+    // One "<gap seconds> <size bytes>" pair per line, comma or whitespace separated; '#' starts a comment
+    static bool load(const std::string &path, std::vector<Entry> &entries, std::string &error) {
+        std::ifstream file(path);
+        if (!file) {
+            error = "cannot open trace '" + path + "'";
+            return false;
+        }
+        std::string line;
+        std::size_t line_number = 0;
+        while (std::getline(file, line)) {
+            line_number++;
+            line = line.substr(0, line.find('#'));
+            std::replace(line.begin(), line.end(), ',', ' ');
+            std::istringstream fields(line);
+            double gap_s;
+            std::size_t size;
+            if (!(fields >> gap_s)) continue;
+            if (!(fields >> size) || gap_s < 0.0) {
+                error = path + ":" + std::to_string(line_number) + ": expected '<gap seconds> <size bytes>'";
+                return false;
+            }
+            entries.push_back({static_cast<int64_t>(gap_s * 1e9), size});
+        }
+        if (entries.empty()) {
+            error = "trace '" + path + "' has no entries";
+            return false;
+        }
+        return true;
+    }
+
+private:
+    std::string path_;
+    std::vector<Entry> entries_;
+    bool loop_;
+    std::size_t index_ = 0;
+    std::size_t max_size_ = 0;
+};
+
+constexpr const char *kTrafficProfiles = "constant|poisson[:<seed>]|onoff:<duty>:<period s>|trace:<file>[:loop]";
+
+// Check a traffic profile's syntax without building it; a trace file is only opened by make_arrival_process
+inline bool parse_traffic_profile(const std::string &profile, std::string &error) {
+    std::vector<std::string> fields = split(profile, ':');
+    const std::string &kind = fields[0];
+    auto is_number = [](const std::string &field, double &value) {
+        try {
+            std::size_t used = 0;
+            value = std::stod(field, &used);
+            return used == field.size();
+        } catch (const std::exception &) {
+            return false;
+        }
+    };
+    if (kind == "constant" && fields.size() == 1) return true;
+    if (kind == "poisson" && fields.size() <= 2) {
+        if (fields.size() == 1) return true;
+        try {
+            std::size_t used = 0;
+            std::stoull(fields[1], &used);
+            if (used == fields[1].size() && fields[1][0] != '-') return true;
+        } catch (const std::exception &) {
+        }
+        error = "bad seed in traffic profile '" + profile + "'";
+        return false;
+    }
+    if (kind == "onoff" && fields.size() == 3) {
+        double duty, period_s;
+        if (!is_number(fields[1], duty) || !is_number(fields[2], period_s)) {
+            error = "bad number in traffic profile '" + profile + "'";
+            return false;
+        }
+        if (duty <= 0.0 || duty > 1.0 || period_s <= 0.0) {
+            error = "on/off needs 0 < duty <= 1 and a positive period";
+            return false;
+        }
+        return true;
+    }
+    if (kind == "trace" && (fields.size() == 2 || (fields.size() == 3 && fields[2] == "loop")) && !fields[1].empty()) {
+        return true;
+    }
+    error = "unknown traffic profile '" + profile + "', expected " + kTrafficProfiles;
+    return false;
+}
+
+// Build the arrival process for spec.traffic. drift_free selects the constant profile's scheduler.
+inline std::unique_ptr<ArrivalProcess> make_arrival_process(const StreamSpec &spec, bool drift_free,
+                                                            std::string &error) {
+    if (!parse_traffic_profile(spec.traffic, error)) return nullptr;
+    std::vector<std::string> fields = split(spec.traffic, ':');
+    const std::string &kind = fields[0];
+    try {
+        if (kind == "constant" && fields.size() == 1) {
+            return std::make_unique<ConstantArrivals>(spec.rate, spec.payload, drift_free);
+        }
+        if (kind == "poisson" && fields.size() <= 2) {
+            uint64_t seed = fields.size() == 2 ? std::stoull(fields[1]) : std::random_device()();
+            return std::make_unique<PoissonArrivals>(spec.rate, spec.payload, seed);
+        }
+        if (kind == "onoff" && fields.size() == 3) {
+            double duty = std::stod(fields[1]);
+            double period_s = std::stod(fields[2]);
+            if (duty <= 0.0 || duty > 1.0 || period_s <= 0.0) {
+                error = "on/off needs 0 < duty <= 1 and a positive period";
+                return nullptr;
+            }
+            return std::make_unique<OnOffArrivals>(spec.rate, spec.payload, duty, period_s);
+        }
+        if (kind == "trace" && (fields.size() == 2 || (fields.size() == 3 && fields[2] == "loop"))) {
+            std::vector<TraceArrivals::Entry> entries;
+            if (!TraceArrivals::load(fields[1], entries, error)) return nullptr;
+            return std::make_unique<TraceArrivals>(fields[1], std::move(entries), fields.size() == 3);
+        }
+    } catch (const std::exception &) {
+        error = "bad number in traffic profile '" + spec.traffic + "'";
+        return nullptr;
+    }
+    error = "unknown traffic profile '" + spec.traffic + "', expected " + kTrafficProfiles;
+    return nullptr;
+}
+
+}  // namespace demo
@@ -4,36 +4,140 @@
 #include <cstring>
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
 #include <limits>
+#include <sstream>
 #include <string>
 #include <thread>
 #include <vector>
 #include <mutex>
 #include <atomic>
-
+#include <csignal>
+#include <memory>
+
+#include "demo/batch.hpp"
+#include "demo/chunking.hpp"
+#include "demo/cdr.hpp"
+#include "demo/counting_allocator.hpp"
+#include "demo/crc32c.hpp"
+#include "demo/deadline_scheduler.hpp"
+#include "demo/echo.hpp"
+#include "demo/latency_histogram.hpp"
+#include "demo/payload_content.hpp"
+#include "demo/resource_usage.hpp"
+#include "demo/rpc.hpp"
+#include "demo/sequence_tracker.hpp"
+#include "demo/stream_spec.hpp"
+#include "demo/thread_placement.hpp"
+#include "demo/trace_file.hpp"
+#include "demo/traffic_profile.hpp"
+#include "demo/srv/payload.h"
+#include "example_interfaces/srv/add_two_ints.h"
 #include "rcl/rcl.h"
 #include "rcutils/cmdline_parser.h"
 #include "rcutils/logging_macros.h"
 #include "rcutils/time.h"
+#include "rmw/ret_types.h"
+#include "rmw/serialized_message.h"
+#include "rosidl_runtime_c/primitives_sequence_functions.h"
 #include "rosidl_runtime_c/message_type_support_struct.h"
 #include "std_msgs/msg/u_int8_multi_array.h"
 
+// Set by SIGINT so the run loops can exit and print their summaries; rcl does not install a handler itself
+std::atomic<bool> g_interrupted(false);
+
+void handle_sigint(int) { g_interrupted.store(true); }
+
+struct Options {
+    std::string mode = "sub";
+    std::vector<demo::StreamSpec> streams;
+    double duration = 3.0;
+    bool loan = false;
+    std::string alloc = "malloc";
+    std::size_t pool_depth = 4;
+    std::string scheduler = "deadline";
+    int64_t spin_us = 0;
+    std::string trace_out;
+    uint64_t trace_records = 1 << 20;
+    bool echo = false;
+    std::string take = "single";
+    bool serialized = false;
+    bool checksum = false;
+    std::string loopback_context = "shared";
+    bool resources = false;
+    // --cpus/--rt-priority: the main loop thread of pub and sub, and per stream thread of the parallel modes
+    demo::ThreadPlacement placement;
+    std::vector<demo::ThreadPlacement> stream_placement;
+    bool mlockall = false;
+    // --rpc: no service calls when kind is empty
+    demo::RpcSpec rpc;
+    // --mode startup
+    std::size_t graph_nodes = 10;
+    std::size_t graph_topics = 10;
+    std::string graph_role = "both";
+    std::string graph_qos = "default";
+    // --rcl-alloc counting|arena: the allocators handed to rcl, one per call site; null for the default allocator
+    std::string rcl_alloc = "default";
+    demo::AllocatorRegistry *allocators = nullptr;
+};
+
+// The allocator for one rcl call site, such as the context or a topic's publisher
+rcutils_allocator_t site_allocator(const Options &opts, const std::string &site) {
+    return opts.allocators ? opts.allocators->get(site) : rcl_get_default_allocator();
+}
+
 void print_help(const char *program) {
     std::cout
         << "Usage: " << program
-        << " [--mode pub|sub|parallel_pub] [--topic1 <name>] [--topic2 <name>] [--duration <sec>] [--rate1 <Hz>] [--rate2 <Hz>] [--payload1 <bytes>] [--payload2 <bytes>] [--help]\n";
+        << " [--mode pub|sub|parallel_pub|parallel_sub|loopback|startup] [--stream <name>:<Hz>:<bytes>[:<qos>]]... [--topic1 <name>] [--topic2 <name>] [--duration <sec>] [--rate1 <Hz>] [--rate2 <Hz>] [--payload1 <bytes>] [--payload2 <bytes>] [--loan] [--alloc pool|malloc] [--pool-depth <n>] [--scheduler deadline|legacy] [--spin-us <us>] [--qos <name>:<qos>]... [--traffic <name>:<profile>]... [--content <name>:<content>]... [--batch <name>:<records>[:<linger ms>]]... [--chunk <name>:<fragment bytes>[:<MB/s>[:<burst>]]]... [--trace-out <file>] [--trace-records <n>] [--echo] [--take single|batch] [--serialized] [--checksum] [--loopback-context shared|separate] [--resources] [--cpus [<name>:]<list>]... [--rt-priority [<name>:]<1-99>]... [--mlockall] [--rpc <service>] [--rpc-rate <Hz>] [--rpc-timeout <ms>] [--graph-nodes <n>] [--graph-topics <n>] [--graph-role pub|sub|both] [--graph-qos <qos>] [--rcl-alloc default|counting|arena] [--help]\n"
+        << "  --stream can be repeated and replaces the --topic/--rate/--payload pairs\n"
+        << "  <qos> is <preset>[,<key>=<value>]..., <preset> is one of " << demo::kQosPresets << " and the settings are "
+        << demo::kQosSettings << "\n"
+        << "  --traffic sets the arrival process of a stream, <profile> is one of " << demo::kTrafficProfiles
+        << "\n"
+        << "  --content sets what a stream's payload holds, <content> is one of " << demo::kPayloadContents << "\n"
+        << "  --batch packs a stream's samples into one message per <records>, or sooner once the oldest has waited\n"
+        << "  <linger ms>; each record keeps its own id and timestamp. Set it on both sides\n"
+        << "  --chunk sends a stream's samples as fragments of up to <fragment bytes>, paced at <MB/s> with bursts of\n"
+        << "  <burst> fragments, and reassembles them on the subscriber. Set it on both sides; subscribers size the\n"
+        << "  reassembly buffer from the stream's <bytes>, so give them the full --stream too\n"
+        << "  --trace-out records every message to a ring of --trace-records entries, see trace_convert\n"
+        << "  --echo makes subscribers reply on <name>/echo and publishers report round trips; set it on both sides\n"
+        << "  --take batch drains every ready subscription into reused storage instead of taking one sample per wakeup\n"
+        << "  --serialized publishes and takes raw CDR buffers, skipping (de)serialization; set it on both sides\n"
+        << "  --checksum stores a CRC32C of each payload after its header and counts mismatches; set it on both sides\n"
+        << "  loopback publishes and subscribes in this process on one clock, from two nodes on one context or, with\n"
+        << "  --loopback-context separate, on two contexts so samples cross the rmw between sessions\n"
+        << "  --resources logs CPU, context switches, page faults and RSS of this process and a local rmw_zenohd\n"
+        << "  parallel_pub and parallel_sub run each stream on its own thread, with its own wait set when subscribing\n"
+        << "  --cpus pins the loop thread to a CPU list such as 1,3 or 0-2, --rt-priority runs it SCHED_FIFO; with\n"
+        << "  <name>: they apply to that stream's thread in the parallel modes only. In loopback they only pin the\n"
+        << "  publisher; the subscriber thread keeps the default placement\n"
+        << "  --mlockall locks all current and future memory to keep page faults off the measured path\n"
+        << "  --rpc serves a service in sub modes and calls it at --rpc-rate in pub modes, both in loopback, and\n"
+        << "  reports round trips and calls unanswered within --rpc-timeout; <service> is one of " << demo::kRpcKinds
+        << "\n"
+        << "  startup times rcl_init and the creation, first match and first sample of --graph-nodes nodes with\n"
+        << "  --graph-topics publishers, subscriptions or both each; it ends when every subscription has a sample\n"
+        << "  or after --duration\n"
+        << "  --rcl-alloc counting gives the context, nodes and every publisher and subscription a counting allocator\n"
+        << "  and reports allocations per publish and take; arena also serves them from size-class pools\n";
 }
 
-bool parse_args(int argc, char *argv[], std::string &mode, std::string &topic1_name, std::string &topic2_name,
-                double &duration, double &rate1, double &rate2, std::size_t &payload1, std::size_t &payload2) {
-    mode = "sub";
-    topic1_name = "topic_1";
-    topic2_name = "topic_2";
-    duration = 3.0;
-    rate1 = 1.0;
-    rate2 = 2.0;
-    payload1 = 20;
-    payload2 = 40;
+bool parse_args(int argc, char *argv[], Options &opts) {
+    std::string topic1_name = "topic_1";
+    std::string topic2_name = "topic_2";
+    double rate1 = 1.0;
+    double rate2 = 2.0;
+    std::size_t payload1 = 20;
+    std::size_t payload2 = 40;
+    std::vector<std::string> qos;
+    std::vector<std::string> traffic;
+    std::vector<std::string> content;
+    std::vector<std::string> batch;
+    std::vector<std::string> chunk;
+    std::vector<std::string> cpus;
+    std::vector<std::string> priorities;
 
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
@@ -41,13 +145,21 @@ bool parse_args(int argc, char *argv[], std::string &mode, std::string &topic1_n
             print_help(argv[0]);
             return false;
         } else if (arg == "--mode" && i + 1 < argc) {
-            mode = argv[++i];
+            opts.mode = argv[++i];
+        } else if (arg == "--stream" && i + 1 < argc) {
+            demo::StreamSpec spec;
+            std::string error;
+            if (!demo::parse_stream_spec(argv[++i], spec, error)) {
+                std::cerr << "Invalid --stream: " << error << "\n";
+                return false;
+            }
+            opts.streams.push_back(spec);
         } else if (arg == "--topic1" && i + 1 < argc) {
             topic1_name = argv[++i];
         } else if (arg == "--topic2" && i + 1 < argc) {
             topic2_name = argv[++i];
         } else if (arg == "--duration" && i + 1 < argc) {
-            duration = std::stod(argv[++i]);
+            opts.duration = std::stod(argv[++i]);
         } else if (arg == "--rate1" && i + 1 < argc) {
             rate1 = std::stod(argv[++i]);
         } else if (arg == "--rate2" && i + 1 < argc) {
@@ -56,6 +168,68 @@ bool parse_args(int argc, char *argv[], std::string &mode, std::string &topic1_n
             payload1 = static_cast<std::size_t>(std::stoul(argv[++i]));
         } else if (arg == "--payload2" && i + 1 < argc) {
             payload2 = static_cast<std::size_t>(std::stoul(argv[++i]));
+        } else if (arg == "--loan") {
+            opts.loan = true;
+        } else if (arg == "--alloc" && i + 1 < argc) {
+            opts.alloc = argv[++i];
+        } else if (arg == "--pool-depth" && i + 1 < argc) {
+            opts.pool_depth = static_cast<std::size_t>(std::stoul(argv[++i]));
+        } else if (arg == "--scheduler" && i + 1 < argc) {
+            opts.scheduler = argv[++i];
+        } else if (arg == "--spin-us" && i + 1 < argc) {
+            opts.spin_us = std::stoll(argv[++i]);
+        } else if (arg == "--qos" && i + 1 < argc) {
+            qos.push_back(argv[++i]);
+        } else if (arg == "--traffic" && i + 1 < argc) {
+            traffic.push_back(argv[++i]);
+        } else if (arg == "--content" && i + 1 < argc) {
+            content.push_back(argv[++i]);
+        } else if (arg == "--batch" && i + 1 < argc) {
+            batch.push_back(argv[++i]);
+        } else if (arg == "--chunk" && i + 1 < argc) {
+            chunk.push_back(argv[++i]);
+        } else if (arg == "--trace-out" && i + 1 < argc) {
+            opts.trace_out = argv[++i];
+        } else if (arg == "--trace-records" && i + 1 < argc) {
+            opts.trace_records = std::stoull(argv[++i]);
+        } else if (arg == "--echo") {
+            opts.echo = true;
+        } else if (arg == "--serialized") {
+            opts.serialized = true;
+        } else if (arg == "--checksum") {
+            opts.checksum = true;
+        } else if (arg == "--resources") {
+            opts.resources = true;
+        } else if (arg == "--loopback-context" && i + 1 < argc) {
+            opts.loopback_context = argv[++i];
+        } else if (arg == "--cpus" && i + 1 < argc) {
+            cpus.push_back(argv[++i]);
+        } else if (arg == "--rt-priority" && i + 1 < argc) {
+            priorities.push_back(argv[++i]);
+        } else if (arg == "--mlockall") {
+            opts.mlockall = true;
+        } else if (arg == "--rpc" && i + 1 < argc) {
+            std::string error;
+            if (!demo::parse_rpc_spec(argv[++i], opts.rpc, error)) {
+                std::cerr << "Invalid --rpc: " << error << "\n";
+                return false;
+            }
+        } else if (arg == "--graph-nodes" && i + 1 < argc) {
+            opts.graph_nodes = static_cast<std::size_t>(std::stoul(argv[++i]));
+        } else if (arg == "--graph-topics" && i + 1 < argc) {
+            opts.graph_topics = static_cast<std::size_t>(std::stoul(argv[++i]));
+        } else if (arg == "--graph-role" && i + 1 < argc) {
+            opts.graph_role = argv[++i];
+        } else if (arg == "--graph-qos" && i + 1 < argc) {
+            opts.graph_qos = argv[++i];
+        } else if (arg == "--rcl-alloc" && i + 1 < argc) {
+            opts.rcl_alloc = argv[++i];
+        } else if (arg == "--rpc-rate" && i + 1 < argc) {
+            opts.rpc.rate = std::stod(argv[++i]);
+        } else if (arg == "--rpc-timeout" && i + 1 < argc) {
+            opts.rpc.timeout_s = std::stod(argv[++i]) / 1e3;
+        } else if (arg == "--take" && i + 1 < argc) {
+            opts.take = argv[++i];
         } else {
             std::cerr << "Unknown arg: " << arg << "\n";
             print_help(argv[0]);
@@ -63,41 +237,224 @@ bool parse_args(int argc, char *argv[], std::string &mode, std::string &topic1_n
         }
     }
 
-    if (mode != "pub" && mode != "sub" && mode != "parallel_pub") {
+    if (opts.mode != "pub" && opts.mode != "sub" && opts.mode != "parallel_pub" &&
+        opts.mode != "parallel_sub" && opts.mode != "loopback" && opts.mode != "startup") {
         std::cerr << "Invalid --mode\n";
         return false;
     }
+    if (opts.loopback_context != "shared" && opts.loopback_context != "separate") {
+        std::cerr << "Invalid --loopback-context\n";
+        return false;
+    }
+    if (opts.alloc != "pool" && opts.alloc != "malloc") {
+        std::cerr << "Invalid --alloc\n";
+        return false;
+    }
+    if (opts.rcl_alloc != "default" && opts.rcl_alloc != "counting" && opts.rcl_alloc != "arena") {
+        std::cerr << "Invalid --rcl-alloc\n";
+        return false;
+    }
+    if (opts.pool_depth == 0) {
+        std::cerr << "Invalid --pool-depth\n";
+        return false;
+    }
+    if (opts.scheduler != "deadline" && opts.scheduler != "legacy") {
+        std::cerr << "Invalid --scheduler\n";
+        return false;
+    }
+    if (opts.spin_us < 0) {
+        std::cerr << "Invalid --spin-us\n";
+        return false;
+    }
+    if (opts.take != "single" && opts.take != "batch") {
+        std::cerr << "Invalid --take\n";
+        return false;
+    }
+    if (opts.trace_records == 0) {
+        std::cerr << "Invalid --trace-records\n";
+        return false;
+    }
+    if (opts.graph_nodes == 0 || opts.graph_topics == 0) {
+        std::cerr << "Invalid --graph-nodes or --graph-topics\n";
+        return false;
+    }
+    if (opts.graph_role != "pub" && opts.graph_role != "sub" && opts.graph_role != "both") {
+        std::cerr << "Invalid --graph-role\n";
+        return false;
+    }
+    rmw_qos_profile_t graph_qos;
+    std::string graph_qos_error;
+    if (!demo::parse_qos(opts.graph_qos, graph_qos, graph_qos_error)) {
+        std::cerr << "Invalid --graph-qos: " << graph_qos_error << "\n";
+        return false;
+    }
+    if (opts.rpc.rate <= 0.0 || opts.rpc.timeout_s <= 0.0) {
+        std::cerr << "Invalid --rpc-rate or --rpc-timeout\n";
+        return false;
+    }
+    // Calls would add discovery and traffic to the timings, and no server would answer them
+    if (!opts.rpc.kind.empty() && opts.mode == "startup") {
+        std::cerr << "Invalid --rpc: not supported with --mode startup\n";
+        return false;
+    }
+
+    // Without --stream, fall back to the classic small/large topic pair
+    if (opts.streams.empty()) {
+        demo::StreamSpec stream1, stream2;
+        stream1.name = topic1_name;
+        stream1.rate = rate1;
+        stream1.payload = payload1;
+        stream2.name = topic2_name;
+        stream2.rate = rate2;
+        stream2.payload = payload2;
+        opts.streams = {stream1, stream2};
+    }
+    std::string error;
+    if (!demo::finalize_streams(opts.streams, error)) {
+        std::cerr << "Invalid --stream: " << error << "\n";
+        return false;
+    }
+
+    for (const auto &item : qos) {
+        std::string value;
+        demo::StreamSpec *stream = demo::find_stream_option(opts.streams, item, value);
+        rmw_qos_profile_t profile;
+        if (!stream) {
+            std::cerr << "Invalid --qos: expected <name>:<qos> naming a stream, got '" << item << "'\n";
+            return false;
+        } else if (!demo::parse_qos(value, profile, error)) {
+            std::cerr << "Invalid --qos: " << error << "\n";
+            return false;
+        }
+        stream->qos = value;
+    }
+    for (const auto &item : traffic) {
+        std::string value;
+        demo::StreamSpec *stream = demo::find_stream_option(opts.streams, item, value);
+        if (!stream) {
+            std::cerr << "Invalid --traffic: expected <name>:<profile> naming a stream, got '" << item << "'\n";
+            return false;
+        } else if (!demo::parse_traffic_profile(value, error)) {
+            std::cerr << "Invalid --traffic: " << error << "\n";
+            return false;
+        }
+        stream->traffic = value;
+    }
+    for (const auto &item : content) {
+        std::string value;
+        demo::StreamSpec *stream = demo::find_stream_option(opts.streams, item, value);
+        if (!stream) {
+            std::cerr << "Invalid --content: expected <name>:<content> naming a stream, got '" << item << "'\n";
+            return false;
+        } else if (!demo::parse_payload_content(value, error)) {
+            std::cerr << "Invalid --content: " << error << "\n";
+            return false;
+        }
+        stream->content = value;
+    }
+    for (const auto &item : batch) {
+        std::string value;
+        demo::StreamSpec *stream = demo::find_stream_option(opts.streams, item, value);
+        demo::BatchSpec spec;
+        if (!stream) {
+            std::cerr << "Invalid --batch: expected <name>:<records>[:<linger ms>] naming a stream, got '" << item
+                      << "'\n";
+            return false;
+        } else if (!demo::parse_batch_spec(value, spec, error)) {
+            std::cerr << "Invalid --batch: " << error << "\n";
+            return false;
+        }
+        stream->batch = value;
+    }
+    for (const auto &item : chunk) {
+        std::string value;
+        demo::StreamSpec *stream = demo::find_stream_option(opts.streams, item, value);
+        demo::ChunkSpec spec;
+        if (!stream) {
+            std::cerr << "Invalid --chunk: expected <name>:<fragment bytes>[:<MB/s>[:<burst>]] naming a stream, got '"
+                      << item << "'\n";
+            return false;
+        } else if (!demo::parse_chunk_spec(value, spec, error)) {
+            std::cerr << "Invalid --chunk: " << error << "\n";
+            return false;
+        } else if (!stream->batch.empty()) {
+            std::cerr << "Invalid --chunk: " << stream->name << " is already batched\n";
+            return false;
+        }
+        stream->chunk = value;
+    }
+
+    // Unprefixed values set the loop thread and the default of every stream thread, so apply them first
+    auto is_stream_option = [](const std::string &item) { return item.find(':') != std::string::npos; };
+    for (const auto &item : cpus) {
+        if (!is_stream_option(item) && !demo::parse_cpu_list(item, opts.placement.cpus, error)) {
+            std::cerr << "Invalid --cpus: " << error << "\n";
+            return false;
+        }
+    }
+    for (const auto &item : priorities) {
+        if (!is_stream_option(item) && !demo::parse_rt_priority(item, opts.placement.priority, error)) {
+            std::cerr << "Invalid --rt-priority: " << error << "\n";
+            return false;
+        }
+    }
+    opts.stream_placement.assign(opts.streams.size(), opts.placement);
+    auto stream_placement = [&](const std::string &item, std::string &value) -> demo::ThreadPlacement * {
+        demo::StreamSpec *stream = demo::find_stream_option(opts.streams, item, value);
+        return stream ? &opts.stream_placement[stream - opts.streams.data()] : nullptr;
+    };
+    for (const auto &item : cpus) {
+        if (!is_stream_option(item)) continue;
+        std::string value;
+        demo::ThreadPlacement *placement = stream_placement(item, value);
+        if (!placement) {
+            std::cerr << "Invalid --cpus: expected [<name>:]<list> naming a stream, got '" << item << "'\n";
+            return false;
+        } else if (!demo::parse_cpu_list(value, placement->cpus, error)) {
+            std::cerr << "Invalid --cpus: " << error << "\n";
+            return false;
+        }
+    }
+    for (const auto &item : priorities) {
+        if (!is_stream_option(item)) continue;
+        std::string value;
+        demo::ThreadPlacement *placement = stream_placement(item, value);
+        if (!placement) {
+            std::cerr << "Invalid --rt-priority: expected [<name>:]<priority> naming a stream, got '" << item
+                      << "'\n";
+            return false;
+        } else if (!demo::parse_rt_priority(value, placement->priority, error)) {
+            std::cerr << "Invalid --rt-priority: " << error << "\n";
+            return false;
+        }
+    }
     return true;
 }
 
-std_msgs__msg__UInt8MultiArray create_message(size_t payload, uint8_t fill_byte, uint32_t msg_id) {
-    static thread_local std::vector<uint8_t> base_payload1, base_payload2;
-    static thread_local size_t last_payload1_size = 0, last_payload2_size = 0;
-    static thread_local uint8_t last_fill_byte1 = 0, last_fill_byte2 = 0;
+// What write_header stamps on one outgoing payload
+struct SampleHeader {
+    uint32_t msg_id;
+    // --checksum: the body CRC of this payload size, see crc32c.hpp
+    bool checksum;
+    uint32_t body_crc;
+};
 
-    std::vector<uint8_t>* current_base;
-    size_t* last_size;
-    uint8_t* last_fill;
+// Stamp the msg_id and send timestamp, and the checksum when enabled, at the front of the payload
+void write_header(uint8_t *data, size_t payload, const SampleHeader &header) {
+    if (payload < sizeof(uint32_t)) return;
+    memcpy(data, &header.msg_id, sizeof(uint32_t));
 
-    // Use different base payloads for different fill bytes to avoid conflicts
-    if (fill_byte == 0xA1) {
-        current_base = &base_payload1;
-        last_size = &last_payload1_size;
-        last_fill = &last_fill_byte1;
-    } else {
-        current_base = &base_payload2;
-        last_size = &last_payload2_size;
-        last_fill = &last_fill_byte2;
+    auto timestamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    if (payload >= sizeof(uint32_t) + sizeof(int64_t)) {
+        memcpy(data + sizeof(uint32_t), &timestamp, sizeof(int64_t));
     }
-
-    // Only recreate base payload if size or fill byte changed
-    if (*last_size != payload || *last_fill != fill_byte) {
-        current_base->resize(payload);
-        std::fill(current_base->begin(), current_base->end(), fill_byte);
-        *last_size = payload;
-        *last_fill = fill_byte;
+    if (header.checksum && payload >= demo::kChecksumHeaderSize) {
+        demo::write_payload_checksum(data, header.body_crc);
     }
+}
 
+std_msgs__msg__UInt8MultiArray create_message(const std::vector<uint8_t> &base, size_t payload,
+                                              const SampleHeader &header) {
     std_msgs__msg__UInt8MultiArray msg;
     std_msgs__msg__UInt8MultiArray__init(&msg);
     msg.data.size = payload;
@@ -105,19 +462,62 @@ std_msgs__msg__UInt8MultiArray create_message(size_t payload, uint8_t fill_byte,
     msg.data.data = static_cast<uint8_t *>(malloc(payload));
 
     // Copy the base payload
-    memcpy(msg.data.data, current_base->data(), payload);
-
-    // Update only the msg_id and timestamp
-    memcpy(msg.data.data, &msg_id, sizeof(uint32_t));
+    memcpy(msg.data.data, base.data(), payload);
 
-    auto timestamp = std::chrono::steady_clock::now().time_since_epoch().count();
-    if (payload >= sizeof(uint32_t) + sizeof(int64_t)) {
-        memcpy(msg.data.data + sizeof(uint32_t), &timestamp, sizeof(int64_t));
-    }
+    // Update only the header
+    write_header(msg.data.data, payload, header);
 
     return msg;
 }
 
+// Ring of preallocated messages reused across publishes, so the publish loop neither mallocs nor frees.
+// Every buffer is filled once up front, which also faults in all of its pages before the first publish.
+class MessagePool {
+public:
+    MessagePool() = default;
+    MessagePool(const MessagePool &) = delete;
+    MessagePool &operator=(const MessagePool &) = delete;
+    ~MessagePool() { release(); }
+
+    bool init(size_t depth, const std::vector<uint8_t> &base) {
+        release();
+        size_t payload = base.size();
+        slots_.resize(depth);
+        for (auto &msg : slots_) {
+            if (!std_msgs__msg__UInt8MultiArray__init(&msg) ||
+                !rosidl_runtime_c__uint8__Sequence__init(&msg.data, payload)) {
+                RCUTILS_LOG_ERROR("Failed to preallocate a %zu byte message", payload);
+                release();
+                return false;
+            }
+            memcpy(msg.data.data, base.data(), payload);
+        }
+        next_ = 0;
+        return true;
+    }
+
+    // Hand out the next slot trimmed to payload bytes, which must not exceed the base it was filled from,
+    // with only its header rewritten
+    std_msgs__msg__UInt8MultiArray *next(const SampleHeader &header, size_t payload) {
+        std_msgs__msg__UInt8MultiArray *msg = &slots_[next_];
+        next_ = (next_ + 1) % slots_.size();
+        msg->data.size = payload;
+        write_header(msg->data.data, msg->data.size, header);
+        return msg;
+    }
+
+    void release() {
+        for (auto &msg : slots_) {
+            std_msgs__msg__UInt8MultiArray__fini(&msg);
+        }
+        slots_.clear();
+    }
+
+private:
+    std::vector<std_msgs__msg__UInt8MultiArray> slots_;
+    size_t next_ = 0;
+};
+
 bool publish_message(rcl_publisher_t *publisher, std_msgs__msg__UInt8MultiArray *msg, const std::string &topic_name) {
     if (rcl_publish(publisher, msg, nullptr) == RCL_RET_OK) {
         return true;
@@ -127,6 +527,92 @@ bool publish_message(rcl_publisher_t *publisher, std_msgs__msg__UInt8MultiArray
     }
 }
 
+// Whether a publisher should try the middleware's loaned-message path, and how often it actually did.
+struct LoanState {
+    bool enabled = false;
+    size_t loaned = 0;
+};
+
+// Decide once per publisher whether loaning is possible, so the hot loop never asks the rmw again.
+void init_loan_state(LoanState &loan, bool requested, const rcl_publisher_t *publisher, const std::string &topic_name) {
+    loan.enabled = requested && rcl_publisher_can_loan_messages(publisher);
+    loan.loaned = 0;
+    if (requested && !loan.enabled) {
+        RCUTILS_LOG_WARN("%s: the middleware cannot loan messages, falling back to copying", topic_name.c_str());
+    }
+}
+
+// Fill a message borrowed from the middleware and publish it without an application-side buffer.
+// Returns false when the loan cannot carry the payload; loaning is then disabled for this publisher
+// and the caller publishes through the copying path instead.
+bool publish_loaned_message(rcl_publisher_t *publisher, const std::vector<uint8_t> &base, size_t payload,
+                            const SampleHeader &header, const std::string &topic_name, LoanState &loan) {
+    const rosidl_message_type_support_t *ts = ROSIDL_GET_MSG_TYPE_SUPPORT(std_msgs, msg, UInt8MultiArray);
+    void *loaned = nullptr;
+    if (rcl_borrow_loaned_message(publisher, ts, &loaned) != RCL_RET_OK) {
+        RCUTILS_LOG_WARN("rcl_borrow_loaned_message on %s: %s, falling back to copying", topic_name.c_str(),
+                         rcutils_get_error_string().str);
+        rcutils_reset_error();
+        loan.enabled = false;
+        return false;
+    }
+
+    // UInt8MultiArray has an unbounded sequence, so the loan is only usable when the middleware already
+    // provides storage for the payload. Allocating it here would make the loan pointless and leak.
+    auto *msg = static_cast<std_msgs__msg__UInt8MultiArray *>(loaned);
+    if (msg->data.data == nullptr || msg->data.capacity < payload) {
+        RCUTILS_LOG_WARN("%s: loaned message has no storage for %zu bytes, falling back to copying",
+                         topic_name.c_str(), payload);
+        if (rcl_return_loaned_message_from_publisher(publisher, loaned) != RCL_RET_OK) {
+            RCUTILS_LOG_ERROR("rcl_return_loaned_message_from_publisher to %s: %s", topic_name.c_str(),
+                              rcutils_get_error_string().str);
+        }
+        loan.enabled = false;
+        return false;
+    }
+
+    msg->data.size = payload;
+    memcpy(msg->data.data, base.data(), payload);
+    write_header(msg->data.data, payload, header);
+
+    // On success the middleware takes the loan back, on failure it stays with us
+    if (rcl_publish_loaned_message(publisher, loaned, nullptr) != RCL_RET_OK) {
+        RCUTILS_LOG_ERROR("rcl_publish_loaned_message to %s: %s", topic_name.c_str(), rcutils_get_error_string().str);
+        if (rcl_return_loaned_message_from_publisher(publisher, loaned) != RCL_RET_OK) {
+            RCUTILS_LOG_ERROR("rcl_return_loaned_message_from_publisher to %s: %s", topic_name.c_str(),
+                              rcutils_get_error_string().str);
+        }
+        return true;
+    }
+    loan.loaned++;
+    return true;
+}
+
+// Publish one sample, through a loan when enabled, otherwise from the pool if one is given and through a
+// freshly created message as a last resort.
+bool publish_sample(rcl_publisher_t *publisher, const std::vector<uint8_t> &base, size_t payload,
+                    const SampleHeader &header, const std::string &topic_name, LoanState &loan, MessagePool *pool) {
+    if (loan.enabled) {
+        size_t loaned_before = loan.loaned;
+        if (publish_loaned_message(publisher, base, payload, header, topic_name, loan)) {
+            return loan.loaned != loaned_before;
+        }
+    }
+
+    if (pool) {
+        return publish_message(publisher, pool->next(header, payload), topic_name);
+    }
+
+    auto msg = create_message(base, payload, header);
+    bool ok = publish_message(publisher, &msg, topic_name);
+    std_msgs__msg__UInt8MultiArray__fini(&msg);
+    return ok;
+}
+
+const char *loan_label(const LoanState &loan) {
+    return loan.enabled ? "loaned" : "copied";
+}
+
 std::string format_bytes(size_t bytes) {
     if (bytes >= 1024 * 1024 * 1024) {
         return std::to_string(bytes / (1024 * 1024 * 1024)) + " GB";
@@ -139,407 +625,1825 @@ std::string format_bytes(size_t bytes) {
     }
 }
 
-void run_dual_publisher(rcl_node_t *node, const std::string &topic1, const std::string &topic2,
-                        double duration, double rate1, double rate2, size_t payload1, size_t payload2) {
-    rcl_publisher_t publisher1 = rcl_get_zero_initialized_publisher();
-    rcl_publisher_t publisher2 = rcl_get_zero_initialized_publisher();
-    const rosidl_message_type_support_t *ts = ROSIDL_GET_MSG_TYPE_SUPPORT(std_msgs, msg, UInt8MultiArray);
+// Everything one publishing stream owns. Streams are kept in containers that are sized once, so the
+// rcl handles never move after init.
+struct PublisherStream {
+    demo::StreamSpec spec;
+    uint32_t index = 0;
+    demo::TraceWriter *trace = nullptr;
+    rcl_publisher_t publisher = rcl_get_zero_initialized_publisher();
+    std::vector<uint8_t> base;
+    LoanState loan;
+    MessagePool pool;
+    bool use_pool = false;
+    size_t count = 0;
+    size_t count_last_status = 0;
+    size_t bytes = 0;
+    uint32_t msg_id = 0;
+    std::unique_ptr<demo::ArrivalProcess> arrivals;
+    bool checksum = false;
+    demo::BodyCrcCache body_crc;
+    uint64_t skipped_last_status = 0;
+    // How far behind its scheduled release each send started, and how long the publish call itself took. A
+    // publish that blocks under congestion control shows up in the duration of its own stream and in the
+    // lateness of the streams that share its loop.
+    demo::LatencyHistogram send_lateness;
+    demo::LatencyHistogram send_lateness_total;
+    demo::LatencyHistogram publish_duration;
+    demo::LatencyHistogram publish_duration_total;
+    // --serialized: one CDR buffer sized for the largest message, with the payload already in place
+    bool use_serialized = false;
+    rcl_serialized_message_t serialized = rmw_get_zero_initialized_serialized_message();
+    // --rcl-alloc: what the publish calls allocated through the counting allocators
+    bool count_allocations = false;
+    demo::AllocationCounter publish_allocations;
+    demo::AllocationRate publish_allocation_rate;
+    // --batch: samples are appended here and sent together; count then counts records, not messages
+    bool batching = false;
+    demo::BatchBuilder batcher;
+    uint64_t batches = 0;
+    uint64_t batches_last_status = 0;
+    // --chunk: each sample goes out as fragments of the chunker's buffer, as the bucket allows; count still
+    // counts samples, and the next one waits until the last fragment of this one has been sent
+    bool chunking = false;
+    demo::ChunkSender chunker;
+    demo::TokenBucket bucket;
+    size_t burst = 1;
+    uint32_t frame_id = 0;
+    size_t frame_payload = 0;
+    int64_t frame_start_ns = 0;
+    uint64_t fragments = 0;
+    uint64_t fragments_last_status = 0;
+};
+
+// The QoS the middleware settled on, which may differ from the requested one where the rmw fills in defaults
+void log_actual_qos(const std::string &topic_name, const char *role, const rmw_qos_profile_t *qos) {
+    if (qos) {
+        RCUTILS_LOG_INFO("%s %s QoS: %s", topic_name.c_str(), role, demo::format_qos(*qos).c_str());
+    } else {
+        RCUTILS_LOG_WARN("%s %s QoS unavailable: %s", topic_name.c_str(), role, rcutils_get_error_string().str);
+        rcutils_reset_error();
+    }
+}
 
+bool init_publisher_stream(rcl_node_t *node, const demo::StreamSpec &spec, const Options &opts,
+                           PublisherStream &stream) {
+    const rosidl_message_type_support_t *ts = ROSIDL_GET_MSG_TYPE_SUPPORT(std_msgs, msg, UInt8MultiArray);
     rcl_publisher_options_t pub_opts = rcl_publisher_get_default_options();
-
-    rcl_ret_t rc1 = rcl_publisher_init(&publisher1, node, ts, topic1.c_str(), &pub_opts);
-    if (rc1 != RCL_RET_OK) {
-        RCUTILS_LOG_ERROR("Failed to init publisher1: %s", rcutils_get_error_string().str);
-        return;
+    pub_opts.qos = demo::stream_qos_profile(spec);
+    pub_opts.allocator = site_allocator(opts, spec.name + " publisher");
+    stream.count_allocations = opts.allocators != nullptr;
+
+    std::string error;
+    stream.arrivals = demo::make_arrival_process(spec, opts.scheduler == "deadline", error);
+    if (!stream.arrivals) {
+        RCUTILS_LOG_ERROR("Traffic profile for %s: %s", spec.name.c_str(), error.c_str());
+        return false;
     }
-
-    rcl_ret_t rc2 = rcl_publisher_init(&publisher2, node, ts, topic2.c_str(), &pub_opts);
-    if (rc2 != RCL_RET_OK) {
-        RCUTILS_LOG_ERROR("Failed to init publisher2: %s", rcutils_get_error_string().str);
-        if (rcl_publisher_fini(&publisher1, node) != RCL_RET_OK) {
-            RCUTILS_LOG_ERROR("rcl_publisher_fini publisher1: %s", rcutils_get_error_string().str);
+    // Content every message of the stream starts from, generated once here; only the header is rewritten per
+    // publish. Streams with varying sizes size it for their largest message and send a prefix of it.
+    if (!demo::make_payload_content(spec.content, stream.arrivals->max_size(), spec.fill_byte, stream.index,
+                                    stream.base, error)) {
+        RCUTILS_LOG_ERROR("Payload content for %s: %s", spec.name.c_str(), error.c_str());
+        return false;
+    }
+    stream.checksum = opts.checksum;
+    if (stream.checksum && stream.base.size() < demo::kChecksumHeaderSize) {
+        RCUTILS_LOG_WARN("%s: payloads under %zu bytes have no room for a checksum and are sent without one",
+                         spec.name.c_str(), demo::kChecksumHeaderSize);
+    }
+    if (!spec.batch.empty()) {
+        demo::BatchSpec batch;
+        demo::parse_batch_spec(spec.batch, batch, error);
+        stream.batcher.init(batch, stream.base.size());
+        stream.batching = true;
+        if (batch.linger_ns > 0) {
+            RCUTILS_LOG_INFO("%s: up to %zu records per message, linger %.1f ms", spec.name.c_str(), batch.count,
+                             batch.linger_ns / 1e6);
+        } else {
+            RCUTILS_LOG_INFO("%s: up to %zu records per message, no linger", spec.name.c_str(), batch.count);
         }
-        return;
+    }
+    if (!spec.chunk.empty()) {
+        demo::ChunkSpec chunk;
+        demo::parse_chunk_spec(spec.chunk, chunk, error);
+        stream.chunker.init(chunk, stream.base);
+        // Capacity in whole fragment messages, so a full bucket releases burst fragments back to back
+        stream.bucket.init(chunk.rate_bytes_per_s,
+                           static_cast<double>(chunk.burst * (demo::kChunkHeaderSize + chunk.fragment_size)),
+                           demo::steady_now_ns());
+        stream.burst = chunk.burst;
+        stream.chunking = true;
+        if (chunk.rate_bytes_per_s > 0.0) {
+            RCUTILS_LOG_INFO("%s: fragments of %zu B at %.1f MB/s, bursts of %zu", spec.name.c_str(),
+                             chunk.fragment_size, chunk.rate_bytes_per_s / 1e6, chunk.burst);
+        } else {
+            RCUTILS_LOG_INFO("%s: fragments of %zu B, unpaced, bursts of %zu", spec.name.c_str(), chunk.fragment_size,
+                             chunk.burst);
+        }
+    }
+    if ((stream.batching || stream.chunking) && (opts.loan || opts.serialized || opts.alloc == "pool")) {
+        RCUTILS_LOG_WARN("%s: batches and fragments are sent as plain messages; --loan, --alloc pool and "
+                         "--serialized do not apply to it", spec.name.c_str());
     }
 
-    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
-    std::chrono::steady_clock::time_point next_pub1 = start;
-    std::chrono::steady_clock::time_point next_pub2 = start;
-    std::chrono::steady_clock::time_point last_status = start;
-
-    double interval1_ms = 1000.0 / rate1;
-    double interval2_ms = 1000.0 / rate2;
-
-    size_t count1 = 0, count2 = 0;
-    size_t count1_last_status = 0, count2_last_status = 0;
-    uint32_t msg_id1 = 0, msg_id2 = 0;
-
-    while (true) {
-        auto now = std::chrono::steady_clock::now();
-        double elapsed = std::chrono::duration<double>(now - start).count();
-        if (duration > 0.0 && elapsed >= duration) break;
-
-        // Print status every 1 second
-        auto time_since_status = std::chrono::duration<double>(now - last_status).count();
-        if (time_since_status >= 1.0) {
-            double current_rate1 = (count1 - count1_last_status) / time_since_status;
-            double current_rate2 = (count2 - count2_last_status) / time_since_status;
-            RCUTILS_LOG_INFO("Publishing: %s %zu msgs (%.1f Hz), %s %zu msgs (%.1f Hz)",
-                           topic1.c_str(), count1, current_rate1,
-                           topic2.c_str(), count2, current_rate2);
-            count1_last_status = count1;
-            count2_last_status = count2;
-            last_status = now;
+    stream.spec = spec;
+    if (rcl_publisher_init(&stream.publisher, node, ts, spec.name.c_str(), &pub_opts) != RCL_RET_OK) {
+        RCUTILS_LOG_ERROR("Failed to init publisher for %s: %s", spec.name.c_str(), rcutils_get_error_string().str);
+        return false;
+    }
+    log_actual_qos(spec.name, "publisher", rcl_publisher_get_actual_qos(&stream.publisher));
+
+    if (opts.serialized) {
+        // The publisher's site, so any growth of this buffer shows up with the publish allocations
+        rcutils_allocator_t allocator = site_allocator(opts, spec.name + " publisher");
+        if (rmw_serialized_message_init(&stream.serialized, demo::kCdrUInt8MultiArrayHeaderSize + stream.base.size(),
+                                        &allocator) != RMW_RET_OK) {
+            RCUTILS_LOG_ERROR("Failed to allocate the %s serialized message: %s", spec.name.c_str(),
+                              rcutils_get_error_string().str);
+            rcl_publisher_fini(&stream.publisher, node);
+            return false;
         }
+        stream.use_serialized = true;
+        memcpy(stream.serialized.buffer + demo::kCdrUInt8MultiArrayHeaderSize, stream.base.data(), stream.base.size());
+        return true;
+    }
+    init_loan_state(stream.loan, opts.loan, &stream.publisher, spec.name);
+    stream.use_pool = opts.alloc == "pool" && stream.pool.init(opts.pool_depth, stream.base);
+    if (opts.alloc == "pool" && !stream.use_pool) {
+        RCUTILS_LOG_WARN("%s: falling back to per-publish allocation", spec.name.c_str());
+    }
+    return true;
+}
+
+void fini_publisher_stream(rcl_node_t *node, PublisherStream &stream) {
+    stream.pool.release();
+    if (stream.use_serialized && rmw_serialized_message_fini(&stream.serialized) != RMW_RET_OK) {
+        RCUTILS_LOG_ERROR("rmw_serialized_message_fini for %s: %s", stream.spec.name.c_str(),
+                          rcutils_get_error_string().str);
+    }
+    if (rcl_publisher_fini(&stream.publisher, node) != RCL_RET_OK) {
+        RCUTILS_LOG_ERROR("rcl_publisher_fini for %s: %s", stream.spec.name.c_str(), rcutils_get_error_string().str);
+    }
+}
 
-        bool should_pub1 = now >= next_pub1;
-        bool should_pub2 = now >= next_pub2;
+// Publish the first payload bytes of the stream's CDR buffer with only the CDR length and our header rewritten
+bool publish_serialized(PublisherStream &stream, size_t payload, const SampleHeader &header) {
+    uint8_t *buffer = stream.serialized.buffer;
+    demo::cdr_write_uint8_multi_array_header(buffer, static_cast<uint32_t>(payload));
+    write_header(buffer + demo::kCdrUInt8MultiArrayHeaderSize, payload, header);
+    stream.serialized.buffer_length = demo::kCdrUInt8MultiArrayHeaderSize + payload;
+    if (rcl_publish_serialized_message(&stream.publisher, &stream.serialized, nullptr) != RCL_RET_OK) {
+        RCUTILS_LOG_ERROR("rcl_publish_serialized_message to %s: %s", stream.spec.name.c_str(),
+                          rcutils_get_error_string().str);
+        return false;
+    }
+    return true;
+}
 
-        if (should_pub1) {
-            auto msg = create_message(payload1, 0xA1, msg_id1);
-            if (publish_message(&publisher1, &msg, topic1)) {
-                count1++;
-                msg_id1++;
+// Send the pending records of a --batch stream as one message. The message only borrows the batch buffer, so
+// nothing is copied or allocated here and it is never finalized.
+void publish_batch(PublisherStream &stream) {
+    std_msgs__msg__UInt8MultiArray msg{};
+    msg.data.data = const_cast<uint8_t *>(stream.batcher.data());
+    msg.data.size = stream.batcher.size();
+    msg.data.capacity = stream.batcher.size();
+    demo::AllocationScope allocations(stream.count_allocations ? &stream.publish_allocations : nullptr);
+    int64_t start_ns = demo::steady_now_ns();
+    bool published = publish_message(&stream.publisher, &msg, stream.spec.name);
+    int64_t duration_ns = demo::steady_now_ns() - start_ns;
+    stream.publish_duration.record(duration_ns);
+    if (published) {
+        demo::for_each_batch_record(msg.data.data, msg.data.size, [&](const uint8_t *record, size_t size) {
+            // Records too short for the [msg_id][timestamp] header go without, as plain samples do
+            uint32_t msg_id = 0;
+            int64_t created_ns = 0;
+            if (size >= sizeof(uint32_t)) memcpy(&msg_id, record, sizeof(uint32_t));
+            if (size >= sizeof(uint32_t) + sizeof(int64_t)) {
+                memcpy(&created_ns, record + sizeof(uint32_t), sizeof(int64_t));
             }
-            std_msgs__msg__UInt8MultiArray__fini(&msg);
-            next_pub1 = now + std::chrono::milliseconds((int)interval1_ms);
+            if (stream.trace) {
+                stream.trace->record(
+                    {stream.index, msg_id, created_ns, 0, static_cast<uint32_t>(size), 0, duration_ns});
+            }
+            stream.count++;
+        });
+        stream.batches++;
+        stream.bytes += msg.data.size;
+    }
+    stream.batcher.clear();
+}
+
+// Send up to a burst of the stream's current --chunk fragments, as far as the token bucket allows at now, so the
+// loop gets back to the other streams in between. Each fragment is published straight from the chunker's buffer.
+// The sample counts as published once its last fragment is out.
+void publish_fragments(PublisherStream &stream, int64_t now) {
+    if (!stream.chunker.sending()) return;
+    for (size_t sent = 0; sent < stream.burst && stream.chunker.sending() &&
+                          stream.bucket.try_take(stream.chunker.next_size(), now);
+         ++sent) {
+        std_msgs__msg__UInt8MultiArray msg{};
+        msg.data.data = const_cast<uint8_t *>(stream.chunker.next_data());
+        msg.data.size = stream.chunker.next_size();
+        msg.data.capacity = msg.data.size;
+        demo::AllocationScope allocations(stream.count_allocations ? &stream.publish_allocations : nullptr);
+        int64_t start_ns = demo::steady_now_ns();
+        bool published = publish_message(&stream.publisher, &msg, stream.spec.name);
+        now = demo::steady_now_ns();
+        stream.publish_duration.record(now - start_ns);
+        if (!published) {
+            stream.chunker.cancel();
+            return;
         }
+        stream.fragments++;
+        stream.chunker.advance();
+    }
+    if (stream.chunker.sending()) return;
+    if (stream.trace) {
+        stream.trace->record({stream.index, stream.frame_id, stream.frame_start_ns, 0,
+                              static_cast<uint32_t>(stream.frame_payload), 0, now - stream.frame_start_ns});
+    }
+    stream.count++;
+    stream.bytes += stream.frame_payload;
+}
 
-        if (should_pub2) {
-            auto msg = create_message(payload2, 0xB2, msg_id2);
-            if (publish_message(&publisher2, &msg, topic2)) {
-                count2++;
-                msg_id2++;
-            }
-            std_msgs__msg__UInt8MultiArray__fini(&msg);
-            next_pub2 = now + std::chrono::milliseconds((int)interval2_ms);
+void publish_next(PublisherStream &stream, size_t payload) {
+    // The body CRC is cached per size and outside the timed call; only the msg_id part is hashed per publish
+    SampleHeader header{stream.msg_id, stream.checksum,
+                        stream.checksum ? stream.body_crc.get(stream.base.data(), payload) : 0};
+    if (stream.batching) {
+        uint8_t *record = stream.batcher.append(payload, demo::steady_now_ns());
+        memcpy(record, stream.base.data(), payload);
+        write_header(record, payload, header);
+        stream.msg_id++;
+        if (stream.batcher.full()) publish_batch(stream);
+        return;
+    }
+    if (stream.chunking) {
+        write_header(stream.chunker.begin(stream.msg_id, payload), payload, header);
+        stream.frame_id = stream.msg_id;
+        stream.frame_payload = payload;
+        stream.frame_start_ns = demo::steady_now_ns();
+        stream.msg_id++;
+        publish_fragments(stream, stream.frame_start_ns);
+        return;
+    }
+    demo::AllocationScope allocations(stream.count_allocations ? &stream.publish_allocations : nullptr);
+    int64_t start_ns = demo::steady_now_ns();
+    bool published = stream.use_serialized
+                         ? publish_serialized(stream, payload, header)
+                         : publish_sample(&stream.publisher, stream.base, payload, header, stream.spec.name,
+                                          stream.loan, stream.use_pool ? &stream.pool : nullptr);
+    int64_t duration_ns = demo::steady_now_ns() - start_ns;
+    stream.publish_duration.record(duration_ns);
+    if (published) {
+        if (stream.trace) {
+            stream.trace->record({stream.index, stream.msg_id, start_ns, 0, static_cast<uint32_t>(payload), 0,
+                                  duration_ns});
         }
+        stream.count++;
+        stream.bytes += payload;
+        stream.msg_id++;
+    }
+}
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+// "topic_1 120 msgs (100.0 Hz, late <latency>, publish call <latency>, 0 skipped)", with the loan outcome added
+// when --loan is set and allocations per publish with --rcl-alloc. Starts the next status interval.
+std::string format_publish_status(PublisherStream &stream, double time_since_status, bool loan) {
+    double current_rate = (stream.count - stream.count_last_status) / time_since_status;
+    uint64_t skipped = stream.arrivals->skipped() - stream.skipped_last_status;
+    char buf[768];
+    snprintf(buf, sizeof(buf), "%s %zu msgs (%.1f Hz%s%s, late %s, publish call %s, %llu skipped)",
+             stream.spec.name.c_str(), stream.count, current_rate, loan ? ", " : "",
+             loan ? loan_label(stream.loan) : "",
+             demo::format_latency_ms(stream.send_lateness).c_str(),
+             demo::format_latency_ms(stream.publish_duration).c_str(), static_cast<unsigned long long>(skipped));
+
+    std::string line = buf;
+    if (stream.batching) {
+        uint64_t batches = stream.batches - stream.batches_last_status;
+        snprintf(buf, sizeof(buf), ", %.1f records per message",
+                 batches ? static_cast<double>(stream.count - stream.count_last_status) / batches : 0.0);
+        line += buf;
+        stream.batches_last_status = stream.batches;
+    }
+    if (stream.chunking) {
+        snprintf(buf, sizeof(buf), ", %llu fragments",
+                 static_cast<unsigned long long>(stream.fragments - stream.fragments_last_status));
+        line += buf;
+        stream.fragments_last_status = stream.fragments;
+    }
+    if (stream.count_allocations) {
+        line += ", " + stream.publish_allocation_rate.format_interval(stream.publish_allocations, stream.count);
     }
 
-    RCUTILS_LOG_INFO("Published %zu messages to %s (%.1f Hz, %zu bytes) and %zu messages to %s (%.1f Hz, %zu bytes)",
-                     count1, topic1.c_str(), rate1, payload1, count2, topic2.c_str(), rate2, payload2);
+    stream.count_last_status = stream.count;
+    stream.skipped_last_status = stream.arrivals->skipped();
+    stream.send_lateness_total.merge(stream.send_lateness);
+    stream.send_lateness.reset();
+    stream.publish_duration_total.merge(stream.publish_duration);
+    stream.publish_duration.reset();
+    return line;
+}
 
-    if (rcl_publisher_fini(&publisher1, node) != RCL_RET_OK) {
-        RCUTILS_LOG_ERROR("rcl_publisher_fini publisher1: %s", rcutils_get_error_string().str);
+void log_publisher_summary(PublisherStream &stream, double elapsed, bool loan) {
+    stream.send_lateness_total.merge(stream.send_lateness);
+    stream.send_lateness.reset();
+    stream.publish_duration_total.merge(stream.publish_duration);
+    stream.publish_duration.reset();
+    RCUTILS_LOG_INFO("Published %zu messages to %s (%s requested, %.1f Hz achieved, %s sent, %llu skipped)",
+                     stream.count, stream.spec.name.c_str(), stream.arrivals->describe().c_str(),
+                     elapsed > 0.0 ? stream.count / elapsed : 0.0, format_bytes(stream.bytes).c_str(),
+                     static_cast<unsigned long long>(stream.arrivals->skipped()));
+    RCUTILS_LOG_INFO("Send lateness on %s over run: %s", stream.spec.name.c_str(),
+                     demo::format_latency_ms(stream.send_lateness_total).c_str());
+    RCUTILS_LOG_INFO("Publish call duration on %s over run: %s", stream.spec.name.c_str(),
+                     demo::format_latency_ms(stream.publish_duration_total).c_str());
+    if (loan) {
+        RCUTILS_LOG_INFO("Loaned %zu of %zu messages on %s", stream.loan.loaned, stream.count,
+                         stream.spec.name.c_str());
+    }
+    if (stream.batching) {
+        RCUTILS_LOG_INFO("Batched %zu records into %llu messages on %s", stream.count,
+                         static_cast<unsigned long long>(stream.batches), stream.spec.name.c_str());
+    }
+    if (stream.chunking) {
+        RCUTILS_LOG_INFO("Sent %zu messages as %llu fragments on %s%s", stream.count,
+                         static_cast<unsigned long long>(stream.fragments), stream.spec.name.c_str(),
+                         stream.chunker.sending() ? ", the last one cut off by the end of the run" : "");
     }
-    if (rcl_publisher_fini(&publisher2, node) != RCL_RET_OK) {
-        RCUTILS_LOG_ERROR("rcl_publisher_fini publisher2: %s", rcutils_get_error_string().str);
+    if (stream.count_allocations) {
+        RCUTILS_LOG_INFO("Allocations per publish on %s over run: %s", stream.spec.name.c_str(),
+                         demo::AllocationRate::format(stream.publish_allocations.allocations.load(),
+                                                      stream.publish_allocations.bytes.load(), stream.count)
+                             .c_str());
     }
 }
 
-void publisher_thread(rcl_node_t *node, const std::string &topic_name, double duration, double rate,
-                     size_t payload, uint8_t fill_byte, std::atomic<bool> &should_stop) {
-    rcl_publisher_t publisher = rcl_get_zero_initialized_publisher();
-    const rosidl_message_type_support_t *ts = ROSIDL_GET_MSG_TYPE_SUPPORT(std_msgs, msg, UInt8MultiArray);
-    rcl_publisher_options_t pub_opts = rcl_publisher_get_default_options();
-
-    rcl_ret_t rc = rcl_publisher_init(&publisher, node, ts, topic_name.c_str(), &pub_opts);
-    if (rc != RCL_RET_OK) {
-        RCUTILS_LOG_ERROR("Failed to init publisher for %s: %s", topic_name.c_str(), rcutils_get_error_string().str);
-        return;
+// Pin the calling thread as requested; a placement that cannot be applied is reported and the run goes on
+void place_thread(const demo::ThreadPlacement &placement, const std::string &label) {
+    if (placement.cpus.empty() && placement.priority == 0) return;
+    std::string error;
+    if (demo::apply_thread_placement(placement, error)) {
+        RCUTILS_LOG_INFO("%s thread: %s", label.c_str(), demo::describe_placement(placement).c_str());
+    } else {
+        RCUTILS_LOG_ERROR("%s thread: %s", label.c_str(), error.c_str());
     }
+}
 
-    auto start = std::chrono::steady_clock::now();
-    double interval_ms = 1000.0 / rate;
-    auto next_pub = start;
-    auto last_status = start;
-    uint32_t msg_id = 0;
-    size_t count = 0;
-    size_t count_last_status = 0;
+// Publish every stream on its own arrival process until the duration elapses, SIGINT arrives, should_stop is set
+// or every stream has run out of trace. With the deadline scheduler the loop sleeps until the earliest release;
+// the legacy one polls every 1 ms.
+void run_publish_loop(PublisherStream *streams, size_t stream_count, const Options &opts,
+                      const std::atomic<bool> *should_stop) {
+    bool drift_free = opts.scheduler == "deadline";
+    demo::DeadlineSleeper sleeper(opts.spin_us * 1000);
+    int64_t start = demo::steady_now_ns();
+    int64_t end = start + static_cast<int64_t>(opts.duration * 1e9);
+    int64_t last_status = start;
+    for (size_t i = 0; i < stream_count; ++i) {
+        streams[i].arrivals->start(start);
+    }
 
-    while (!should_stop.load()) {
-        auto now = std::chrono::steady_clock::now();
-        double elapsed = std::chrono::duration<double>(now - start).count();
-        if (duration > 0.0 && elapsed >= duration) break;
+    int64_t now = start;
+    while (!g_interrupted.load() && !(should_stop && should_stop->load())) {
+        now = demo::steady_now_ns();
+        if (opts.duration > 0.0 && now >= end) break;
 
         // Print status every 1 second
-        auto time_since_status = std::chrono::duration<double>(now - last_status).count();
+        double time_since_status = (now - last_status) / 1e9;
         if (time_since_status >= 1.0) {
-            double current_rate = (count - count_last_status) / time_since_status;
-            RCUTILS_LOG_INFO("Publishing %s: %zu msgs (%.1f Hz)",
-                           topic_name.c_str(), count, current_rate);
-            count_last_status = count;
+            std::string line;
+            for (size_t i = 0; i < stream_count; ++i) {
+                line += (line.empty() ? "" : ", ") + format_publish_status(streams[i], time_since_status, opts.loan);
+            }
+            RCUTILS_LOG_INFO("Publishing: %s", line.c_str());
             last_status = now;
         }
 
-        if (now >= next_pub) {
-            auto msg = create_message(payload, fill_byte, msg_id);
-            if (publish_message(&publisher, &msg, topic_name)) {
-                count++;
-                msg_id++;
+        int64_t wake = last_status + 1000000000;
+        bool active = false;
+        for (size_t i = 0; i < stream_count; ++i) {
+            // A batch that has lingered long enough goes out before the next record starts a new one
+            demo::BatchBuilder &batcher = streams[i].batcher;
+            if (streams[i].batching && batcher.has_deadline()) {
+                if (now >= batcher.deadline_ns()) {
+                    publish_batch(streams[i]);
+                } else {
+                    wake = std::min(wake, batcher.deadline_ns());
+                }
+            }
+            demo::ArrivalProcess &arrivals = *streams[i].arrivals;
+            // A --chunk frame still going out holds back the stream's next sample, whose lateness then shows the
+            // backlog. Its fragments go out as the bucket allows, between the other streams' samples.
+            publish_fragments(streams[i], now);
+            bool sending = streams[i].chunker.sending();
+            if (!sending && !arrivals.exhausted() && now >= arrivals.next_ns()) {
+                streams[i].send_lateness.record(demo::steady_now_ns() - arrivals.next_ns());
+                publish_next(streams[i], arrivals.next_size());
+                arrivals.advance(now);
+                sending = streams[i].chunker.sending();
+            }
+            if (sending) {
+                wake = std::min(wake, streams[i].bucket.ready_ns(streams[i].chunker.next_size(), now));
+                active = true;
+            } else if (!arrivals.exhausted()) {
+                wake = std::min(wake, arrivals.next_ns());
+                active = true;
             }
-            std_msgs__msg__UInt8MultiArray__fini(&msg);
-            next_pub = now + std::chrono::milliseconds((int)interval_ms);
         }
+        if (!active) break;
+        if (opts.duration > 0.0) wake = std::min(wake, end);
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        if (drift_free) {
+            sleeper.sleep_until(wake);
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
     }
 
-    RCUTILS_LOG_INFO("Thread for %s published %zu messages (%.1f Hz, %zu bytes)",
-                     topic_name.c_str(), count, rate, payload);
+    // A last, partial batch still goes out
+    for (size_t i = 0; i < stream_count; ++i) {
+        if (streams[i].batching && !streams[i].batcher.empty()) publish_batch(streams[i]);
+    }
 
-    if (rcl_publisher_fini(&publisher, node) != RCL_RET_OK) {
-        RCUTILS_LOG_ERROR("rcl_publisher_fini for %s: %s", topic_name.c_str(), rcutils_get_error_string().str);
+    double elapsed = (demo::steady_now_ns() - start) / 1e9;
+    for (size_t i = 0; i < stream_count; ++i) {
+        log_publisher_summary(streams[i], elapsed, opts.loan);
     }
 }
 
-void run_parallel_publisher(rcl_node_t *node, const std::string &topic1, const std::string &topic2,
-                           double duration, double rate1, double rate2, size_t payload1, size_t payload2) {
-    std::atomic<bool> should_stop(false);
-
-    std::thread thread1(publisher_thread, node, std::ref(topic1), duration, rate1, payload1, 0xA1, std::ref(should_stop));
-    std::thread thread2(publisher_thread, node, std::ref(topic2), duration, rate2, payload2, 0xB2, std::ref(should_stop));
+// Replies to one stream's messages in --echo mode
+struct EchoStream {
+    std::string topic;
+    rcl_subscription_t subscription = rcl_get_zero_initialized_subscription();
+    size_t count = 0;
+    demo::EchoStats stats;
+};
 
-    if (duration > 0.0) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int>(duration * 1000)));
-    } else {
-        thread1.join();
-        thread2.join();
-        return;
+void take_echo(EchoStream &stream) {
+    std_msgs__msg__UInt8MultiArray msg;
+    std_msgs__msg__UInt8MultiArray__init(&msg);
+    if (rcl_take(&stream.subscription, &msg, nullptr, nullptr) == RCL_RET_OK) {
+        int64_t t4 = demo::steady_now_ns();
+        demo::EchoTimestamps ts;
+        if (demo::read_echo_reply(msg.data.data, msg.data.size, ts)) {
+            stream.count++;
+            stream.stats.record(ts, t4);
+        }
     }
-
-    should_stop.store(true);
-    thread1.join();
-    thread2.join();
+    std_msgs__msg__UInt8MultiArray__fini(&msg);
 }
 
-void run_dual_subscriber(rcl_node_t *node, const std::string &topic1, const std::string &topic2, double duration) {
-    rcl_subscription_t subscription1 = rcl_get_zero_initialized_subscription();
-    rcl_subscription_t subscription2 = rcl_get_zero_initialized_subscription();
+// Takes the subscribers' replies on its own thread and wait set, so each reply is timestamped when it arrives
+// rather than when the publish loop next wakes up. Runs until should_stop is set or SIGINT arrives.
+void run_echo_receiver(rcl_node_t *node, const Options &opts, const std::atomic<bool> &should_stop) {
     const rosidl_message_type_support_t *ts = ROSIDL_GET_MSG_TYPE_SUPPORT(std_msgs, msg, UInt8MultiArray);
-    rcl_subscription_options_t sub_opts = rcl_subscription_get_default_options();
-
-    rcl_ret_t rc1 = rcl_subscription_init(&subscription1, node, ts, topic1.c_str(), &sub_opts);
-    if (rc1 != RCL_RET_OK) {
-        RCUTILS_LOG_ERROR("Failed to init subscription1: %s", rcutils_get_error_string().str);
-        return;
-    }
+    std::vector<EchoStream> streams(opts.streams.size());
 
-    rcl_ret_t rc2 = rcl_subscription_init(&subscription2, node, ts, topic2.c_str(), &sub_opts);
-    if (rc2 != RCL_RET_OK) {
-        RCUTILS_LOG_ERROR("Failed to init subscription2: %s", rcutils_get_error_string().str);
-        if (rcl_subscription_fini(&subscription1, node) != RCL_RET_OK) {
-            RCUTILS_LOG_ERROR("rcl_subscription_fini subscription1: %s", rcutils_get_error_string().str);
+    auto fini_subscriptions = [&](size_t initialized) {
+        for (size_t i = 0; i < initialized; ++i) {
+            if (rcl_subscription_fini(&streams[i].subscription, node) != RCL_RET_OK) {
+                RCUTILS_LOG_ERROR("rcl_subscription_fini %s: %s", streams[i].topic.c_str(),
+                                  rcutils_get_error_string().str);
+            }
+        }
+    };
+
+    for (size_t i = 0; i < streams.size(); ++i) {
+        streams[i].topic = demo::echo_topic(opts.streams[i].name);
+        rcl_subscription_options_t sub_opts = rcl_subscription_get_default_options();
+        sub_opts.qos = demo::stream_qos_profile(opts.streams[i]);
+        if (rcl_subscription_init(&streams[i].subscription, node, ts, streams[i].topic.c_str(), &sub_opts) !=
+            RCL_RET_OK) {
+            RCUTILS_LOG_ERROR("Failed to init subscription %s: %s", streams[i].topic.c_str(),
+                              rcutils_get_error_string().str);
+            fini_subscriptions(i);
+            return;
         }
-        return;
     }
 
     rcl_wait_set_t wait_set = rcl_get_zero_initialized_wait_set();
-    if (rcl_wait_set_init(&wait_set, 2, 0, 0, 0, 0, 0, node->context, rcl_get_default_allocator()) != RCL_RET_OK) {
+    if (rcl_wait_set_init(&wait_set, streams.size(), 0, 0, 0, 0, 0, node->context, rcl_get_default_allocator()) !=
+        RCL_RET_OK) {
         RCUTILS_LOG_ERROR("rcl_wait_set_init: %s", rcutils_get_error_string().str);
-        if (rcl_subscription_fini(&subscription1, node) != RCL_RET_OK) {
-            RCUTILS_LOG_ERROR("rcl_subscription_fini subscription1: %s", rcutils_get_error_string().str);
-        }
-        if (rcl_subscription_fini(&subscription2, node) != RCL_RET_OK) {
-            RCUTILS_LOG_ERROR("rcl_subscription_fini subscription2: %s", rcutils_get_error_string().str);
-        }
+        fini_subscriptions(streams.size());
         return;
     }
 
-    auto start = std::chrono::steady_clock::now();
-    auto last_rate_display = start;
-    uint32_t count1 = 0, count2 = 0;
-    uint32_t count1_last_second = 0, count2_last_second = 0;
-    double latency_sum1 = 0.0, latency_sum2 = 0.0;
-    uint32_t latency_count1 = 0, latency_count2 = 0;
-    double latency_sum1_last_second = 0.0, latency_sum2_last_second = 0.0;
-    uint32_t latency_count1_last_second = 0, latency_count2_last_second = 0;
-    size_t payload_size1 = 0, payload_size2 = 0;
-
-    uint32_t first_msg_id1 = 0, first_msg_id2 = 0;
-    uint32_t last_msg_id1 = 0, last_msg_id2 = 0;
-    uint32_t missed_events1 = 0, missed_events2 = 0;
-    bool first_msg1 = true, first_msg2 = true;
+    int64_t last_status = demo::steady_now_ns();
+    while (!g_interrupted.load() && !should_stop.load()) {
+        int64_t now = demo::steady_now_ns();
+        if (now - last_status >= 1000000000) {
+            std::string line;
+            for (auto &stream : streams) {
+                line += (line.empty() ? "" : ", ") + stream.topic + " " + stream.stats.format_status();
+            }
+            RCUTILS_LOG_INFO("Echo: %s", line.c_str());
+            last_status = now;
+        }
 
+        if (rcl_wait_set_clear(&wait_set) != RCL_RET_OK) break;
+        bool added = true;
+        for (auto &stream : streams) {
+            if (rcl_wait_set_add_subscription(&wait_set, &stream.subscription, nullptr) != RCL_RET_OK) {
+                RCUTILS_LOG_ERROR("rcl_wait_set_add_subscription %s: %s", stream.topic.c_str(),
+                                  rcutils_get_error_string().str);
+                added = false;
+                break;
+            }
+        }
+        if (!added) break;
 
-    while (1) {
-        auto now = std::chrono::steady_clock::now();
-        if (duration > 0.0) {
-            double elapsed = std::chrono::duration<double>(now - start).count();
-            if (elapsed >= duration) break;
+        if (rcl_wait(&wait_set, RCL_MS_TO_NS(100)) == RCL_RET_TIMEOUT) continue;
+        for (size_t i = 0; i < streams.size(); ++i) {
+            if (wait_set.subscriptions[i] == &streams[i].subscription) {
+                take_echo(streams[i]);
+            }
         }
+    }
 
-        auto time_since_last_display = std::chrono::duration<double>(now - last_rate_display).count();
-        if (time_since_last_display >= 1.0) {
-            double rate1 = (count1 - count1_last_second) / time_since_last_display;
-            double rate2 = (count2 - count2_last_second) / time_since_last_display;
+    for (auto &stream : streams) {
+        RCUTILS_LOG_INFO("%zu replies on %s over run: %s", stream.count, stream.topic.c_str(),
+                         stream.stats.format_summary().c_str());
+    }
 
-            double avg_latency1 = std::numeric_limits<double>::quiet_NaN();
-            double avg_latency2 = std::numeric_limits<double>::quiet_NaN();
-            uint32_t msgs_with_latency1 = latency_count1 - latency_count1_last_second;
-            uint32_t msgs_with_latency2 = latency_count2 - latency_count2_last_second;
+    if (rcl_wait_set_fini(&wait_set) != RCL_RET_OK) {
+        RCUTILS_LOG_ERROR("rcl_wait_set_fini: %s", rcutils_get_error_string().str);
+    }
+    fini_subscriptions(streams.size());
+}
 
-            if (msgs_with_latency1 > 0) {
-                avg_latency1 = (latency_sum1 - latency_sum1_last_second) / msgs_with_latency1;
-            }
-            if (msgs_with_latency2 > 0) {
-                avg_latency2 = (latency_sum2 - latency_sum2_last_second) / msgs_with_latency2;
+// Give discovery up to timeout_s to match every stream with a subscription, so a run started next to its
+// subscriber does not count the first samples as lost
+void wait_for_subscriptions(const std::vector<PublisherStream> &streams, double timeout_s) {
+    int64_t deadline = demo::steady_now_ns() + static_cast<int64_t>(timeout_s * 1e9);
+    for (const auto &stream : streams) {
+        size_t matched = 0;
+        while (!g_interrupted.load() && demo::steady_now_ns() < deadline) {
+            if (rcl_publisher_get_subscription_count(&stream.publisher, &matched) != RCL_RET_OK) {
+                RCUTILS_LOG_ERROR("rcl_publisher_get_subscription_count %s: %s", stream.spec.name.c_str(),
+                                  rcutils_get_error_string().str);
+                rcutils_reset_error();
+                break;
             }
+            if (matched > 0) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        if (matched == 0) {
+            RCUTILS_LOG_WARN("%s: no subscription matched within %.1f s, publishing anyway", stream.spec.name.c_str(),
+                             timeout_s);
+        }
+    }
+}
 
-            double loss_rate1;
-            if (count1_last_second == count1) {
-                loss_rate1 = 100.0;
-            } else {
-                uint32_t total_expected1 = (first_msg1) ? 0 : last_msg_id1 - first_msg_id1;
-                loss_rate1 = (total_expected1 == 0) ? 0.0 : static_cast<double>(missed_events1) / total_expected1 * 100.0;
+void run_dual_publisher(rcl_node_t *node, const Options &opts, demo::TraceWriter *trace) {
+    std::vector<PublisherStream> streams(opts.streams.size());
+    for (size_t i = 0; i < streams.size(); ++i) {
+        streams[i].index = static_cast<uint32_t>(i);
+        streams[i].trace = trace;
+        if (!init_publisher_stream(node, opts.streams[i], opts, streams[i])) {
+            for (size_t j = 0; j < i; ++j) {
+                fini_publisher_stream(node, streams[j]);
             }
+            return;
+        }
+    }
 
-            double loss_rate2;
-            if (count2_last_second == count2) {
-                loss_rate2 = 100.0;
-            } else {
-                uint32_t total_expected2 = (first_msg2) ? 0 : last_msg_id2 - first_msg_id2;
-                loss_rate2 = (total_expected2 == 0) ? 0.0 : static_cast<double>(missed_events2) / total_expected2 * 100.0;
-            }
+    if (opts.mode == "loopback") {
+        wait_for_subscriptions(streams, 5.0);
+    }
+
+    std::atomic<bool> echo_stop(false);
+    std::thread echo_thread;
+    if (opts.echo) {
+        echo_thread = std::thread(run_echo_receiver, node, std::cref(opts), std::cref(echo_stop));
+    }
+
+    // After spawning the echo receiver, so that thread keeps the default placement
+    place_thread(opts.placement, "Publisher");
+    run_publish_loop(streams.data(), streams.size(), opts, nullptr);
+
+    if (echo_thread.joinable()) {
+        echo_stop.store(true);
+        echo_thread.join();
+    }
+
+    for (auto &stream : streams) {
+        fini_publisher_stream(node, stream);
+    }
+}
+
+void publisher_thread(rcl_node_t *node, uint32_t index, const Options &opts, demo::TraceWriter *trace,
+                      std::atomic<bool> &should_stop) {
+    place_thread(opts.stream_placement[index], opts.streams[index].name);
+    PublisherStream stream;
+    stream.index = index;
+    stream.trace = trace;
+    if (!init_publisher_stream(node, opts.streams[index], opts, stream)) {
+        return;
+    }
+
+    run_publish_loop(&stream, 1, opts, &should_stop);
+
+    fini_publisher_stream(node, stream);
+}
+
+void run_parallel_publisher(rcl_node_t *node, const Options &opts, demo::TraceWriter *trace) {
+    std::atomic<bool> should_stop(false);
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < opts.streams.size(); ++i) {
+        threads.emplace_back(publisher_thread, node, i, std::cref(opts), trace, std::ref(should_stop));
+    }
+    if (opts.echo) {
+        threads.emplace_back(run_echo_receiver, node, std::cref(opts), std::cref(should_stop));
+    }
+
+    if (opts.duration > 0.0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int>(opts.duration * 1000)));
+        should_stop.store(true);
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+// Per-stream subscriber statistics
+struct SubscriberStream {
+    demo::StreamSpec spec;
+    uint32_t index = 0;
+    demo::TraceWriter *trace = nullptr;
+    rcl_subscription_t subscription = rcl_get_zero_initialized_subscription();
+    uint32_t count = 0;
+    uint32_t count_last_second = 0;
+    size_t payload_size = 0;
+    // The interval histogram is folded into the whole-run one at every status line
+    demo::LatencyHistogram latency;
+    demo::LatencyHistogram latency_total;
+    demo::SequenceTracker sequence;
+    demo::SequenceStats sequence_last_second;
+    // --echo: every message is answered on echo_name from a preallocated reply
+    bool echo = false;
+    std::string echo_name;
+    rcl_publisher_t echo_publisher = rcl_get_zero_initialized_publisher();
+    std_msgs__msg__UInt8MultiArray echo_reply{};
+    // --take batch: one message reused by every take, and how many samples each wakeup drained
+    bool batch = false;
+    std_msgs__msg__UInt8MultiArray batch_msg{};
+    uint64_t wakeups = 0;
+    uint64_t wakeups_last_second = 0;
+    size_t batch_max = 0;
+    size_t batch_max_total = 0;
+    // --serialized: every take lands in this buffer, which only grows; the payload is read in place
+    bool serialized = false;
+    rcl_serialized_message_t serialized_msg = rmw_get_zero_initialized_serialized_message();
+    size_t malformed = 0;
+    // --checksum: payloads whose CRC32C did not match, and ones too short to carry one
+    bool checksum = false;
+    uint64_t corrupt = 0;
+    uint64_t corrupt_last_second = 0;
+    uint64_t unchecked = 0;
+    // --rcl-alloc: what the take calls allocated through the counting allocators
+    bool count_allocations = false;
+    demo::AllocationCounter take_allocations;
+    demo::AllocationRate take_allocation_rate;
+    // --batch: every message is unpacked and each record accounted on its own
+    bool unbatch = false;
+    uint64_t batches = 0;
+    uint64_t batches_last_second = 0;
+    uint64_t bad_batches = 0;
+    // --chunk: fragments are reassembled in place and every completed frame is accounted as one sample; the
+    // reassembly histograms time the first to the last fragment of each frame
+    bool unchunk = false;
+    demo::Reassembler reassembly;
+    demo::LatencyHistogram reassembly_latency;
+    demo::LatencyHistogram reassembly_latency_total;
+    uint64_t incomplete_last_second = 0;
+    uint64_t bad_fragments = 0;
+};
+
+// Account one received payload; take_start is when the rcl_take that produced it began
+void record_sample(SubscriberStream &stream, const uint8_t *data, size_t size, int64_t take_start,
+                   int64_t recv_timestamp) {
+    stream.count++;
+    stream.payload_size = size;
+
+    uint32_t msg_id = 0;
+    if (size >= sizeof(uint32_t)) {
+        memcpy(&msg_id, data, sizeof(uint32_t));
+        stream.sequence.record(msg_id);
+    }
+
+    int64_t send_timestamp = 0;
+    if (size >= sizeof(uint32_t) + sizeof(int64_t)) {
+        memcpy(&send_timestamp, data + sizeof(uint32_t), sizeof(int64_t));
+        stream.latency.record(recv_timestamp - send_timestamp);
+    }
+
+    if (stream.trace) {
+        stream.trace->record({stream.index, msg_id, send_timestamp, recv_timestamp, static_cast<uint32_t>(size), 0,
+                              recv_timestamp - take_start});
+    }
+
+    // After the timestamps, so checking a large payload never counts as latency
+    if (stream.checksum) {
+        if (size < demo::kChecksumHeaderSize) {
+            stream.unchecked++;
+        } else if (!demo::verify_payload_checksum(data, size)) {
+            stream.corrupt++;
+        }
+    }
+
+    if (stream.echo &&
+        demo::write_echo_reply(stream.echo_reply.data.data, data, size, recv_timestamp, demo::steady_now_ns())) {
+        publish_message(&stream.echo_publisher, &stream.echo_reply, stream.echo_name);
+    }
+}
+
+// Account one received message, record by record when the stream is batched and once its frame is complete when it
+// is chunked. Every record shares the receive time, so its latency includes the time it lingered in the
+// publisher's batch; a frame is received with its last fragment, and traced as taking since its first one.
+void record_payload(SubscriberStream &stream, const uint8_t *data, size_t size, int64_t take_start,
+                    int64_t recv_timestamp) {
+    if (stream.unchunk) {
+        switch (stream.reassembly.add(data, size, recv_timestamp)) {
+            case demo::Reassembler::Result::kComplete:
+                stream.reassembly_latency.record(recv_timestamp - stream.reassembly.first_ns());
+                record_sample(stream, stream.reassembly.frame(), stream.reassembly.frame_size(),
+                              stream.reassembly.first_ns(), recv_timestamp);
+                break;
+            case demo::Reassembler::Result::kInvalid:
+                stream.bad_fragments++;
+                break;
+            case demo::Reassembler::Result::kPending:
+                break;
+        }
+        return;
+    }
+    if (!stream.unbatch) {
+        record_sample(stream, data, size, take_start, recv_timestamp);
+        return;
+    }
+    stream.batches++;
+    if (!demo::for_each_batch_record(data, size, [&](const uint8_t *record, size_t record_size) {
+            record_sample(stream, record, record_size, take_start, recv_timestamp);
+        })) {
+        stream.bad_batches++;
+    }
+}
+
+// One take into the stream's reused storage, the serialized buffer or the batch message. Returns the take result.
+rcl_ret_t take_reused(SubscriberStream &stream) {
+    demo::AllocationScope allocations(stream.count_allocations ? &stream.take_allocations : nullptr);
+    int64_t take_start = demo::steady_now_ns();
+    if (!stream.serialized) {
+        rcl_ret_t rc = rcl_take(&stream.subscription, &stream.batch_msg, nullptr, nullptr);
+        if (rc == RCL_RET_OK) {
+            record_payload(stream, stream.batch_msg.data.data, stream.batch_msg.data.size, take_start,
+                          demo::steady_now_ns());
+        }
+        return rc;
+    }
+
+    rcl_ret_t rc = rcl_take_serialized_message(&stream.subscription, &stream.serialized_msg, nullptr, nullptr);
+    if (rc == RCL_RET_OK) {
+        int64_t recv_timestamp = demo::steady_now_ns();
+        const uint8_t *data;
+        size_t size;
+        if (demo::cdr_uint8_multi_array_data(stream.serialized_msg.buffer, stream.serialized_msg.buffer_length, data,
+                                             size)) {
+            record_payload(stream, data, size, take_start, recv_timestamp);
+        } else {
+            stream.malformed++;
+        }
+    }
+    return rc;
+}
+
+void take_message(SubscriberStream &stream) {
+    if (stream.serialized) {
+        take_reused(stream);
+        return;
+    }
+    std_msgs__msg__UInt8MultiArray msg;
+    std_msgs__msg__UInt8MultiArray__init(&msg);
+    demo::AllocationScope allocations(stream.count_allocations ? &stream.take_allocations : nullptr);
+    int64_t take_start = demo::steady_now_ns();
+    rcl_ret_t rc = rcl_take(&stream.subscription, &msg, nullptr, nullptr);
+    if (rc == RCL_RET_OK) {
+        record_payload(stream, msg.data.data, msg.data.size, take_start, demo::steady_now_ns());
+    }
+    std_msgs__msg__UInt8MultiArray__fini(&msg);
+}
+
+// Take until the subscription's queue is empty, all into the same storage. For deserialized takes the C
+// typesupport still reallocates the payload sequence each time; what is saved is the message init/fini and,
+// more importantly, a wait per queued sample.
+void drain_subscription(SubscriberStream &stream) {
+    size_t taken = 0;
+    while (true) {
+        rcl_ret_t rc = take_reused(stream);
+        if (rc != RCL_RET_OK) {
+            if (rc != RCL_RET_SUBSCRIPTION_TAKE_FAILED) {
+                RCUTILS_LOG_ERROR("rcl_take %s: %s", stream.spec.name.c_str(), rcutils_get_error_string().str);
+                rcutils_reset_error();
+            }
+            break;
+        }
+        taken++;
+    }
+    stream.wakeups++;
+    stream.batch_max = std::max(stream.batch_max, taken);
+}
+
+// "topic_1: 64 B, 87.6 Hz, <latency>, <loss>", then starts the next interval
+std::string format_subscriber_status(SubscriberStream &stream, double time_since_last_display) {
+    double rate = (stream.count - stream.count_last_second) / time_since_last_display;
+
+    // Nothing arrived at all in this interval, so there is no id to measure a gap against
+    std::string loss = (stream.count_last_second == stream.count)
+                           ? "loss: 100.00%"
+                           : demo::format_loss(stream.sequence.stats() - stream.sequence_last_second);
+
+    std::ostringstream line;
+    line << stream.spec.name << ": " << format_bytes(stream.payload_size) << ", " << std::fixed
+         << std::setprecision(1) << rate << " Hz, " << demo::format_latency_ms(stream.latency) << ", " << loss;
+    if (stream.checksum) {
+        line << ", corrupt: " << stream.corrupt - stream.corrupt_last_second;
+        stream.corrupt_last_second = stream.corrupt;
+    }
+    if (stream.batch) {
+        uint64_t wakeups = stream.wakeups - stream.wakeups_last_second;
+        line << ", " << (wakeups ? static_cast<double>(stream.count - stream.count_last_second) / wakeups : 0.0)
+             << " per wakeup (max " << stream.batch_max << ")";
+        stream.wakeups_last_second = stream.wakeups;
+        stream.batch_max_total = std::max(stream.batch_max_total, stream.batch_max);
+        stream.batch_max = 0;
+    }
+    if (stream.unbatch) {
+        uint64_t batches = stream.batches - stream.batches_last_second;
+        line << ", " << (batches ? static_cast<double>(stream.count - stream.count_last_second) / batches : 0.0)
+             << " records per message";
+        stream.batches_last_second = stream.batches;
+    }
+    if (stream.unchunk) {
+        line << ", reassembly " << demo::format_latency_ms(stream.reassembly_latency)
+             << ", incomplete: " << stream.reassembly.incomplete() - stream.incomplete_last_second;
+        stream.incomplete_last_second = stream.reassembly.incomplete();
+        stream.reassembly_latency_total.merge(stream.reassembly_latency);
+        stream.reassembly_latency.reset();
+    }
+    if (stream.count_allocations) {
+        line << ", " << stream.take_allocation_rate.format_interval(stream.take_allocations, stream.count);
+    }
+
+    stream.count_last_second = stream.count;
+    stream.sequence_last_second = stream.sequence.stats();
+    stream.latency_total.merge(stream.latency);
+    stream.latency.reset();
+    return line.str();
+}
+
+void fini_subscriber_stream(rcl_node_t *node, SubscriberStream &stream) {
+    if (rcl_subscription_fini(&stream.subscription, node) != RCL_RET_OK) {
+        RCUTILS_LOG_ERROR("rcl_subscription_fini %s: %s", stream.spec.name.c_str(), rcutils_get_error_string().str);
+    }
+    if (stream.batch && !stream.serialized) {
+        std_msgs__msg__UInt8MultiArray__fini(&stream.batch_msg);
+    }
+    if (stream.serialized && rmw_serialized_message_fini(&stream.serialized_msg) != RMW_RET_OK) {
+        RCUTILS_LOG_ERROR("rmw_serialized_message_fini for %s: %s", stream.spec.name.c_str(),
+                          rcutils_get_error_string().str);
+    }
+    if (stream.echo) {
+        std_msgs__msg__UInt8MultiArray__fini(&stream.echo_reply);
+        if (rcl_publisher_fini(&stream.echo_publisher, node) != RCL_RET_OK) {
+            RCUTILS_LOG_ERROR("rcl_publisher_fini for %s: %s", stream.echo_name.c_str(),
+                              rcutils_get_error_string().str);
+        }
+    }
+}
+
+// Create the subscription, its take storage and, with --echo, the reply publisher. Cleans up after itself on
+// failure.
+bool init_subscriber_stream(rcl_node_t *node, const demo::StreamSpec &spec, const Options &opts,
+                            SubscriberStream &stream) {
+    const rosidl_message_type_support_t *ts = ROSIDL_GET_MSG_TYPE_SUPPORT(std_msgs, msg, UInt8MultiArray);
+    stream.spec = spec;
+    rcl_subscription_options_t sub_opts = rcl_subscription_get_default_options();
+    sub_opts.qos = demo::stream_qos_profile(spec);
+    sub_opts.allocator = site_allocator(opts, spec.name + " subscription");
+    stream.count_allocations = opts.allocators != nullptr;
+    if (rcl_subscription_init(&stream.subscription, node, ts, spec.name.c_str(), &sub_opts) != RCL_RET_OK) {
+        RCUTILS_LOG_ERROR("Failed to init subscription %s: %s", spec.name.c_str(), rcutils_get_error_string().str);
+        return false;
+    }
+    log_actual_qos(spec.name, "subscription", rcl_subscription_get_actual_qos(&stream.subscription));
+    stream.batch = opts.take == "batch";
+    stream.checksum = opts.checksum;
+    stream.unbatch = !spec.batch.empty();
+    stream.unchunk = !spec.chunk.empty();
+    // The reassembly buffer is sized from the stream's <bytes>, which subscribers otherwise leave at 0
+    if (stream.unchunk) {
+        stream.reassembly.init(spec.payload);
+        if (spec.payload == 0) {
+            RCUTILS_LOG_WARN("%s: no payload size given with --stream <name>:<Hz>:<bytes>, so the reassembly buffer "
+                             "is allocated when the first frame arrives", spec.name.c_str());
+        }
+    }
+    if (opts.serialized) {
+        // The subscription's site: the rmw grows this buffer on take, which belongs in the take allocations
+        rcutils_allocator_t allocator = site_allocator(opts, spec.name + " subscription");
+        stream.serialized = rmw_serialized_message_init(&stream.serialized_msg, demo::kCdrUInt8MultiArrayHeaderSize,
+                                                        &allocator) == RMW_RET_OK;
+        if (!stream.serialized) {
+            RCUTILS_LOG_ERROR("Failed to allocate the %s serialized message: %s", spec.name.c_str(),
+                              rcutils_get_error_string().str);
+            stream.batch = false;
+            fini_subscriber_stream(node, stream);
+            return false;
+        }
+    } else if (stream.batch) {
+        if (!std_msgs__msg__UInt8MultiArray__init(&stream.batch_msg)) {
+            stream.batch = false;
+            RCUTILS_LOG_ERROR("Failed to init the %s take message", spec.name.c_str());
+            fini_subscriber_stream(node, stream);
+            return false;
+        }
+    }
 
+    if (opts.echo) {
+        stream.echo_name = demo::echo_topic(spec.name);
+        rcl_publisher_options_t pub_opts = rcl_publisher_get_default_options();
+        pub_opts.qos = sub_opts.qos;
+        if (rcl_publisher_init(&stream.echo_publisher, node, ts, stream.echo_name.c_str(), &pub_opts) != RCL_RET_OK) {
+            RCUTILS_LOG_ERROR("Failed to init publisher for %s: %s", stream.echo_name.c_str(),
+                              rcutils_get_error_string().str);
+            fini_subscriber_stream(node, stream);
+            return false;
+        }
+        stream.echo = true;
+        std_msgs__msg__UInt8MultiArray__init(&stream.echo_reply);
+        if (!rosidl_runtime_c__uint8__Sequence__init(&stream.echo_reply.data, demo::kEchoReplySize)) {
+            RCUTILS_LOG_ERROR("Failed to preallocate the %s reply", stream.echo_name.c_str());
+            fini_subscriber_stream(node, stream);
+            return false;
+        }
+    }
+    return true;
+}
 
-            std::cout << topic1 << ": " << format_bytes(payload_size1) << ", " << std::fixed << std::setprecision(1) << rate1 << " Hz, "
-                      << std::setprecision(2) << avg_latency1 << " ms, "
-                      << "loss: " << std::setprecision(2) << loss_rate1 << "%, "
-                      << topic2 << ": " << format_bytes(payload_size2) << ", " << std::setprecision(1) << rate2 << " Hz, "
-                      << std::setprecision(2) << avg_latency2 << " ms, "
-                      << "loss: " << std::setprecision(2) << loss_rate2 << "%" << std::endl;
+// Wait on the given streams with one wait set and take whatever is ready until the duration elapses, SIGINT
+// arrives or should_stop is set, then print the run summary of these streams.
+void run_subscribe_loop(SubscriberStream *streams, size_t stream_count, rcl_context_t *context, const Options &opts,
+                        const std::atomic<bool> *should_stop) {
+    rcl_wait_set_t wait_set = rcl_get_zero_initialized_wait_set();
+    if (rcl_wait_set_init(&wait_set, stream_count, 0, 0, 0, 0, 0, context, rcl_get_default_allocator()) !=
+        RCL_RET_OK) {
+        RCUTILS_LOG_ERROR("rcl_wait_set_init: %s", rcutils_get_error_string().str);
+        return;
+    }
 
-            count1_last_second = count1;
-            count2_last_second = count2;
-            latency_sum1_last_second = latency_sum1;
-            latency_sum2_last_second = latency_sum2;
-            latency_count1_last_second = latency_count1;
-            latency_count2_last_second = latency_count2;
+    auto start = std::chrono::steady_clock::now();
+    auto last_rate_display = start;
+
+    while (!g_interrupted.load() && !(should_stop && should_stop->load())) {
+        auto now = std::chrono::steady_clock::now();
+        if (opts.duration > 0.0) {
+            double elapsed = std::chrono::duration<double>(now - start).count();
+            if (elapsed >= opts.duration) break;
+        }
+
+        auto time_since_last_display = std::chrono::duration<double>(now - last_rate_display).count();
+        if (time_since_last_display >= 1.0) {
+            std::string line;
+            for (size_t i = 0; i < stream_count; ++i) {
+                line += (line.empty() ? "" : ", ") + format_subscriber_status(streams[i], time_since_last_display);
+            }
+            // One write per line so parallel_sub threads do not interleave
+            std::cout << line + "\n" << std::flush;
             last_rate_display = now;
         }
 
         rcl_ret_t rc = rcl_wait_set_clear(&wait_set);
-        if (rcl_wait_set_add_subscription(&wait_set, &subscription1, nullptr) != RCL_RET_OK) {
-            RCUTILS_LOG_ERROR("rcl_wait_set_add_subscription1: %s", rcutils_get_error_string().str);
+        bool added = true;
+        for (size_t i = 0; i < stream_count; ++i) {
+            if (rcl_wait_set_add_subscription(&wait_set, &streams[i].subscription, nullptr) != RCL_RET_OK) {
+                RCUTILS_LOG_ERROR("rcl_wait_set_add_subscription %s: %s", streams[i].spec.name.c_str(),
+                                  rcutils_get_error_string().str);
+                added = false;
+                break;
+            }
+        }
+        if (!added) break;
+
+        rc = rcl_wait(&wait_set, RCL_MS_TO_NS(100));
+        if (rc == RCL_RET_TIMEOUT) continue;
+
+        for (size_t i = 0; i < stream_count; ++i) {
+            if (wait_set.subscriptions[i] != &streams[i].subscription) continue;
+            if (streams[i].batch) {
+                drain_subscription(streams[i]);
+            } else {
+                take_message(streams[i]);
+            }
+        }
+    }
+
+    std::string received;
+    for (size_t i = 0; i < stream_count; ++i) {
+        received += (received.empty() ? "" : ", ") + std::to_string(streams[i].count) + " messages from " +
+                    streams[i].spec.name;
+    }
+    RCUTILS_LOG_INFO("Received %s", received.c_str());
+
+    for (size_t i = 0; i < stream_count; ++i) {
+        SubscriberStream &stream = streams[i];
+        stream.latency_total.merge(stream.latency);
+        std::ostringstream line;
+        line << stream.spec.name << " over run: " << demo::format_latency_ms(stream.latency_total) << ", "
+             << demo::format_loss(stream.sequence.stats());
+        if (stream.checksum) {
+            line << ", corrupt: " << stream.corrupt;
+            if (stream.unchecked) line << " (" << stream.unchecked << " too short to check)";
+        }
+        if (stream.malformed) {
+            line << ", " << stream.malformed << " malformed CDR buffers";
+        }
+        if (stream.batch) {
+            line << ", " << std::fixed << std::setprecision(1)
+                 << (stream.wakeups ? static_cast<double>(stream.count) / stream.wakeups : 0.0) << " per wakeup (max "
+                 << std::max(stream.batch_max_total, stream.batch_max) << ")";
+        }
+        if (stream.unbatch) {
+            line << ", " << stream.count << " records in " << stream.batches << " messages";
+            if (stream.bad_batches) line << " (" << stream.bad_batches << " not valid batches)";
+        }
+        if (stream.unchunk) {
+            // A frame still being assembled now will never be completed
+            stream.reassembly.abandon();
+            stream.reassembly_latency_total.merge(stream.reassembly_latency);
+            line << ", reassembly " << demo::format_latency_ms(stream.reassembly_latency_total)
+                 << ", incomplete: " << stream.reassembly.incomplete();
+            if (stream.bad_fragments) line << " (" << stream.bad_fragments << " not valid fragments)";
+        }
+        if (stream.count_allocations) {
+            line << ", " << demo::AllocationRate::format(stream.take_allocations.allocations.load(),
+                                                         stream.take_allocations.bytes.load(), stream.count);
+        }
+        std::cout << line.str() + "\n" << std::flush;
+    }
+
+    if (rcl_wait_set_fini(&wait_set) != RCL_RET_OK) {
+        RCUTILS_LOG_ERROR("rcl_wait_set_fini: %s", rcutils_get_error_string().str);
+    }
+}
+
+void run_dual_subscriber(rcl_node_t *node, const Options &opts, demo::TraceWriter *trace,
+                         const std::atomic<bool> *should_stop) {
+    std::vector<SubscriberStream> streams(opts.streams.size());
+    for (size_t i = 0; i < streams.size(); ++i) {
+        streams[i].index = static_cast<uint32_t>(i);
+        streams[i].trace = trace;
+        if (!init_subscriber_stream(node, opts.streams[i], opts, streams[i])) {
+            for (size_t j = 0; j < i; ++j) {
+                fini_subscriber_stream(node, streams[j]);
+            }
+            return;
+        }
+    }
+
+    place_thread(opts.placement, "Subscriber");
+    run_subscribe_loop(streams.data(), streams.size(), node->context, opts, should_stop);
+
+    for (auto &stream : streams) {
+        fini_subscriber_stream(node, stream);
+    }
+}
+
+// One subscription with its own wait set, so a slow take on one stream never delays another
+void subscriber_thread(rcl_node_t *node, uint32_t index, const Options &opts, demo::TraceWriter *trace,
+                       std::atomic<bool> &should_stop) {
+    place_thread(opts.stream_placement[index], opts.streams[index].name);
+    SubscriberStream stream;
+    stream.index = index;
+    stream.trace = trace;
+    if (!init_subscriber_stream(node, opts.streams[index], opts, stream)) {
+        return;
+    }
+
+    run_subscribe_loop(&stream, 1, node->context, opts, &should_stop);
+
+    fini_subscriber_stream(node, stream);
+}
+
+void run_parallel_subscriber(rcl_node_t *node, const Options &opts, demo::TraceWriter *trace) {
+    std::atomic<bool> should_stop(false);
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < opts.streams.size(); ++i) {
+        threads.emplace_back(subscriber_thread, node, i, std::cref(opts), trace, std::ref(should_stop));
+    }
+
+    if (opts.duration > 0.0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int>(opts.duration * 1000)));
+        should_stop.store(true);
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+// Logs the resource use of this process, and of the rmw_zenohd router when one runs on this host, every second
+// until should_stop is set, then the whole-run averages. Sampling is a getrusage and a few /proc reads per second.
+void run_resource_monitor(const std::atomic<bool> &should_stop) {
+    std::vector<demo::ResourceMonitor> monitors;
+    monitors.emplace_back("self", 0);
+    pid_t router = demo::find_process("rmw_zenohd");
+    if (router) {
+        monitors.emplace_back("rmw_zenohd", router);
+    } else {
+        RCUTILS_LOG_INFO("Resources: no rmw_zenohd on this host, sampling this process only");
+    }
+
+    int64_t next_status = demo::steady_now_ns() + 1000000000;
+    while (!g_interrupted.load() && !should_stop.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (demo::steady_now_ns() < next_status) continue;
+        next_status += 1000000000;
+        std::string line;
+        for (auto &monitor : monitors) {
+            line += (line.empty() ? "" : ", ") + monitor.format_interval();
+        }
+        RCUTILS_LOG_INFO("Resources: %s", line.c_str());
+    }
+    for (const auto &monitor : monitors) {
+        RCUTILS_LOG_INFO("Resources over run: %s", monitor.format_summary().c_str());
+    }
+}
+
+// The two --rpc services. The client stamps each request with its send time and the server hands the stamp back,
+// so a reply can be matched against the call it answers and not just counted.
+struct AddTwoIntsRpc {
+    using Request = example_interfaces__srv__AddTwoInts_Request;
+    using Response = example_interfaces__srv__AddTwoInts_Response;
+    static constexpr int64_t kAddend = 1;
+
+    static const rosidl_service_type_support_t *type_support() {
+        return ROSIDL_GET_SRV_TYPE_SUPPORT(example_interfaces, srv, AddTwoInts);
+    }
+    static bool init(Request &request, Response &response, const demo::RpcSpec &) {
+        return example_interfaces__srv__AddTwoInts_Request__init(&request) &&
+               example_interfaces__srv__AddTwoInts_Response__init(&response);
+    }
+    static void fini(Request &request, Response &response) {
+        example_interfaces__srv__AddTwoInts_Request__fini(&request);
+        example_interfaces__srv__AddTwoInts_Response__fini(&response);
+    }
+    static void stamp(Request &request, int64_t sent_ns) {
+        request.a = sent_ns;
+        request.b = kAddend;
+    }
+    static bool check(const Response &response, int64_t sent_ns, const demo::RpcSpec &) {
+        return response.sum == sent_ns + kAddend;
+    }
+    static bool serve(const Request &request, Response &response) {
+        response.sum = request.a + request.b;
+        return true;
+    }
+};
+
+struct PayloadRpc {
+    using Request = demo__srv__Payload_Request;
+    using Response = demo__srv__Payload_Response;
+
+    static const rosidl_service_type_support_t *type_support() {
+        return ROSIDL_GET_SRV_TYPE_SUPPORT(demo, srv, Payload);
+    }
+    // Random bytes, so a compressing transport does not shrink the calls
+    static bool init(Request &request, Response &response, const demo::RpcSpec &spec) {
+        if (!demo__srv__Payload_Request__init(&request) || !demo__srv__Payload_Response__init(&response)) return false;
+        rosidl_runtime_c__uint8__Sequence__fini(&request.data);
+        if (!rosidl_runtime_c__uint8__Sequence__init(&request.data, spec.request_size)) return false;
+        if (spec.request_size > 0) demo::fill_random(request.data.data, request.data.size, 0);
+        request.response_size = static_cast<uint32_t>(spec.response_size);
+        return true;
+    }
+    static void fini(Request &request, Response &response) {
+        demo__srv__Payload_Request__fini(&request);
+        demo__srv__Payload_Response__fini(&response);
+    }
+    static void stamp(Request &request, int64_t sent_ns) {
+        if (request.data.size > 0) {
+            std::memcpy(request.data.data, &sent_ns, std::min(sizeof(sent_ns), request.data.size));
+        }
+    }
+    static bool check(const Response &response, int64_t sent_ns, const demo::RpcSpec &spec) {
+        if (response.data.size != spec.response_size) return false;
+        return response.data.size == 0 ||
+               std::memcmp(response.data.data, &sent_ns, std::min(sizeof(sent_ns), response.data.size)) == 0;
+    }
+    // The response buffer is only reallocated when the requested size changes
+    static bool serve(const Request &request, Response &response) {
+        if (response.data.size != request.response_size) {
+            rosidl_runtime_c__uint8__Sequence__fini(&response.data);
+            if (!rosidl_runtime_c__uint8__Sequence__init(&response.data, request.response_size)) return false;
+            if (response.data.size > 0) demo::fill_random(response.data.data, response.data.size, 1);
+        }
+        std::size_t stamp = std::min({sizeof(int64_t), request.data.size, response.data.size});
+        if (stamp > 0) std::memcpy(response.data.data, request.data.data, stamp);
+        return true;
+    }
+};
+
+// Calls the --rpc service at a fixed rate until should_stop is set, independent of when replies come back, so a
+// stalled service shows up as timeouts rather than as a lower call rate. Calls unanswered after the timeout are
+// counted and forgotten; a late reply to one is ignored.
+template <typename Rpc>
+void run_rpc_client(rcl_node_t *node, const Options &opts, const std::atomic<bool> &should_stop) {
+    const demo::RpcSpec &spec = opts.rpc;
+    std::string service = demo::rpc_service_name(spec);
+    rcl_client_t client = rcl_get_zero_initialized_client();
+    rcl_client_options_t client_opts = rcl_client_get_default_options();
+    if (rcl_client_init(&client, node, Rpc::type_support(), service.c_str(), &client_opts) != RCL_RET_OK) {
+        RCUTILS_LOG_ERROR("Failed to init client %s: %s", service.c_str(), rcutils_get_error_string().str);
+        return;
+    }
+    rcl_wait_set_t wait_set = rcl_get_zero_initialized_wait_set();
+    if (rcl_wait_set_init(&wait_set, 0, 0, 0, 1, 0, 0, node->context, rcl_get_default_allocator()) != RCL_RET_OK) {
+        RCUTILS_LOG_ERROR("rcl_wait_set_init: %s", rcutils_get_error_string().str);
+        if (rcl_client_fini(&client, node) != RCL_RET_OK) {
+            RCUTILS_LOG_ERROR("rcl_client_fini: %s", rcutils_get_error_string().str);
+        }
+        return;
+    }
+    typename Rpc::Request request;
+    typename Rpc::Response response;
+    bool initialized = Rpc::init(request, response, spec);
+    if (!initialized) {
+        RCUTILS_LOG_ERROR("Failed to allocate %s messages", service.c_str());
+    }
+
+    int64_t deadline = demo::steady_now_ns() + 5000000000;
+    bool available = false;
+    while (initialized && !available && !g_interrupted.load() && !should_stop.load() &&
+           demo::steady_now_ns() < deadline) {
+        if (rcl_service_server_is_available(node, &client, &available) != RCL_RET_OK) {
+            RCUTILS_LOG_ERROR("rcl_service_server_is_available: %s", rcutils_get_error_string().str);
+            rcutils_reset_error();
             break;
         }
-        if (rcl_wait_set_add_subscription(&wait_set, &subscription2, nullptr) != RCL_RET_OK) {
-            RCUTILS_LOG_ERROR("rcl_wait_set_add_subscription2: %s", rcutils_get_error_string().str);
+        if (!available) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (initialized && !available) {
+        RCUTILS_LOG_WARN("%s: no server within 5.0 s, calling anyway", service.c_str());
+    }
+    RCUTILS_LOG_INFO("RPC: calling %s, timeout %.0f ms", demo::describe_rpc(spec).c_str(), spec.timeout_s * 1e3);
+
+    demo::PendingCalls pending;
+    demo::RpcStats stats;
+    int64_t period = static_cast<int64_t>(1e9 / spec.rate);
+    int64_t timeout = static_cast<int64_t>(spec.timeout_s * 1e9);
+    int64_t next_call = demo::steady_now_ns();
+    int64_t last_status = next_call;
+    while (initialized && !g_interrupted.load() && !should_stop.load()) {
+        int64_t now = demo::steady_now_ns();
+        if (now >= next_call) {
+            int64_t sequence = 0;
+            Rpc::stamp(request, now);
+            if (rcl_send_request(&client, &request, &sequence) == RCL_RET_OK) {
+                pending.add(sequence, now);
+            } else {
+                RCUTILS_LOG_ERROR("rcl_send_request %s: %s", service.c_str(), rcutils_get_error_string().str);
+                rcutils_reset_error();
+            }
+            next_call += period;
+        }
+        stats.timeout(pending.expire(now - timeout));
+        if (now - last_status >= 1000000000) {
+            RCUTILS_LOG_INFO("RPC: %s %s, %zu in flight", service.c_str(), stats.format_status().c_str(),
+                             pending.size());
+            last_status = now;
+        }
+
+        if (rcl_wait_set_clear(&wait_set) != RCL_RET_OK ||
+            rcl_wait_set_add_client(&wait_set, &client, nullptr) != RCL_RET_OK) {
+            RCUTILS_LOG_ERROR("rcl_wait_set_add_client %s: %s", service.c_str(), rcutils_get_error_string().str);
             break;
         }
+        int64_t wait = std::max<int64_t>(0, std::min<int64_t>(next_call - now, RCL_MS_TO_NS(100)));
+        if (rcl_wait(&wait_set, wait) == RCL_RET_TIMEOUT || !wait_set.clients[0]) continue;
+        rmw_request_id_t header;
+        while (rcl_take_response(&client, &header, &response) == RCL_RET_OK) {
+            int64_t received = demo::steady_now_ns();
+            int64_t sent = 0;
+            if (!pending.complete(header.sequence_number, sent)) continue;
+            if (Rpc::check(response, sent, spec)) {
+                stats.record(received - sent);
+            } else {
+                stats.bad_reply();
+            }
+        }
+    }
+    if (initialized) {
+        RCUTILS_LOG_INFO("RPC: %s over run: %s", service.c_str(), stats.format_summary().c_str());
+    }
 
-        rc = rcl_wait(&wait_set, RCL_MS_TO_NS(100));
-        if (rc == RCL_RET_TIMEOUT) continue;
+    Rpc::fini(request, response);
+    if (rcl_wait_set_fini(&wait_set) != RCL_RET_OK) {
+        RCUTILS_LOG_ERROR("rcl_wait_set_fini: %s", rcutils_get_error_string().str);
+    }
+    if (rcl_client_fini(&client, node) != RCL_RET_OK) {
+        RCUTILS_LOG_ERROR("rcl_client_fini: %s", rcutils_get_error_string().str);
+    }
+}
 
-        if (wait_set.subscriptions[0] == &subscription1) {
-            std_msgs__msg__UInt8MultiArray msg;
-            std_msgs__msg__UInt8MultiArray__init(&msg);
-            rc = rcl_take(&subscription1, &msg, nullptr, nullptr);
-            if (rc == RCL_RET_OK) {
-                count1++;
-                payload_size1 = msg.data.size;
-
-                if (msg.data.size >= sizeof(uint32_t)) {
-                    uint32_t msg_id;
-                    memcpy(&msg_id, msg.data.data, sizeof(uint32_t));
-                    if (first_msg1) {
-                        first_msg_id1 = msg_id;
-                        last_msg_id1 = msg_id;
-                        first_msg1 = false;
-                    } else {
-                        if (msg_id > last_msg_id1 + 1) {
-                            missed_events1++;
-                        }
-                        last_msg_id1 = msg_id;
-                    }
-                }
+// Answers the --rpc service on its own thread and wait set until should_stop is set
+template <typename Rpc>
+void run_rpc_server(rcl_node_t *node, const Options &opts, const std::atomic<bool> &should_stop) {
+    std::string name = demo::rpc_service_name(opts.rpc);
+    rcl_service_t service = rcl_get_zero_initialized_service();
+    rcl_service_options_t service_opts = rcl_service_get_default_options();
+    if (rcl_service_init(&service, node, Rpc::type_support(), name.c_str(), &service_opts) != RCL_RET_OK) {
+        RCUTILS_LOG_ERROR("Failed to init service %s: %s", name.c_str(), rcutils_get_error_string().str);
+        return;
+    }
+    rcl_wait_set_t wait_set = rcl_get_zero_initialized_wait_set();
+    if (rcl_wait_set_init(&wait_set, 0, 0, 0, 0, 1, 0, node->context, rcl_get_default_allocator()) != RCL_RET_OK) {
+        RCUTILS_LOG_ERROR("rcl_wait_set_init: %s", rcutils_get_error_string().str);
+        if (rcl_service_fini(&service, node) != RCL_RET_OK) {
+            RCUTILS_LOG_ERROR("rcl_service_fini: %s", rcutils_get_error_string().str);
+        }
+        return;
+    }
+    typename Rpc::Request request;
+    typename Rpc::Response response;
+    demo::RpcSpec empty;
+    bool initialized = Rpc::init(request, response, empty);
+    if (!initialized) {
+        RCUTILS_LOG_ERROR("Failed to allocate %s messages", name.c_str());
+    } else {
+        RCUTILS_LOG_INFO("RPC: serving %s", name.c_str());
+    }
 
-                if (msg.data.size >= sizeof(uint32_t) + sizeof(int64_t)) {
-                    int64_t send_timestamp;
-                    memcpy(&send_timestamp, msg.data.data + sizeof(uint32_t), sizeof(int64_t));
-                    auto recv_timestamp = std::chrono::steady_clock::now().time_since_epoch().count();
-                    double latency_ms = (recv_timestamp - send_timestamp) / 1e6;
-                    latency_sum1 += latency_ms;
-                    latency_count1++;
-                }
+    size_t served = 0;
+    size_t served_last = 0;
+    int64_t last_status = demo::steady_now_ns();
+    while (initialized && !g_interrupted.load() && !should_stop.load()) {
+        int64_t now = demo::steady_now_ns();
+        if (now - last_status >= 1000000000) {
+            RCUTILS_LOG_INFO("RPC: %s served %zu", name.c_str(), served - served_last);
+            served_last = served;
+            last_status = now;
+        }
+
+        if (rcl_wait_set_clear(&wait_set) != RCL_RET_OK ||
+            rcl_wait_set_add_service(&wait_set, &service, nullptr) != RCL_RET_OK) {
+            RCUTILS_LOG_ERROR("rcl_wait_set_add_service %s: %s", name.c_str(), rcutils_get_error_string().str);
+            break;
+        }
+        if (rcl_wait(&wait_set, RCL_MS_TO_NS(100)) == RCL_RET_TIMEOUT || !wait_set.services[0]) continue;
+        rmw_request_id_t header;
+        while (rcl_take_request(&service, &header, &request) == RCL_RET_OK) {
+            if (!Rpc::serve(request, response)) {
+                RCUTILS_LOG_ERROR("Failed to allocate a %s response", name.c_str());
+                continue;
             }
-            std_msgs__msg__UInt8MultiArray__fini(&msg);
+            if (rcl_send_response(&service, &header, &response) != RCL_RET_OK) {
+                RCUTILS_LOG_ERROR("rcl_send_response %s: %s", name.c_str(), rcutils_get_error_string().str);
+                rcutils_reset_error();
+                continue;
+            }
+            served++;
         }
+    }
+    if (initialized) {
+        RCUTILS_LOG_INFO("RPC: %s served %zu calls over run", name.c_str(), served);
+    }
 
-        if (wait_set.subscriptions[1] == &subscription2) {
-            std_msgs__msg__UInt8MultiArray msg;
-            std_msgs__msg__UInt8MultiArray__init(&msg);
-            rc = rcl_take(&subscription2, &msg, nullptr, nullptr);
-            if (rc == RCL_RET_OK) {
-                count2++;
-                payload_size2 = msg.data.size;
-
-                if (msg.data.size >= sizeof(uint32_t)) {
-                    uint32_t msg_id;
-                    memcpy(&msg_id, msg.data.data, sizeof(uint32_t));
-                    if (first_msg2) {
-                        first_msg_id2 = msg_id;
-                        last_msg_id2 = msg_id;
-                        first_msg2 = false;
-                    } else {
-                        if (msg_id > last_msg_id2 + 1) {
-                            missed_events2++;
-                        }
-                        last_msg_id2 = msg_id;
-                    }
-                }
+    Rpc::fini(request, response);
+    if (rcl_wait_set_fini(&wait_set) != RCL_RET_OK) {
+        RCUTILS_LOG_ERROR("rcl_wait_set_fini: %s", rcutils_get_error_string().str);
+    }
+    if (rcl_service_fini(&service, node) != RCL_RET_OK) {
+        RCUTILS_LOG_ERROR("rcl_service_fini: %s", rcutils_get_error_string().str);
+    }
+}
+
+void run_rpc(rcl_node_t *node, const Options &opts, bool serve, const std::atomic<bool> &should_stop) {
+    bool payload = opts.rpc.kind == "payload";
+    if (serve && payload) {
+        run_rpc_server<PayloadRpc>(node, opts, should_stop);
+    } else if (serve) {
+        run_rpc_server<AddTwoIntsRpc>(node, opts, should_stop);
+    } else if (payload) {
+        run_rpc_client<PayloadRpc>(node, opts, should_stop);
+    } else {
+        run_rpc_client<AddTwoIntsRpc>(node, opts, should_stop);
+    }
+}
+
+// Publisher and subscriber in one process, so latency is read off a single clock and no network, router or second
+// container is involved. The subscriber gets its own node, on the publisher's context or on a context of its own;
+// with rmw_zenoh the latter is a separate session, so samples take the middleware's local transport (or SHM)
+// instead of being delivered within one session.
+void run_loopback(rcl_context_t *context, rcl_node_t *pub_node, const Options &opts, demo::TraceWriter *trace) {
+    bool separate = opts.loopback_context == "separate";
+    rcl_context_t sub_context = rcl_get_zero_initialized_context();
+    if (separate) {
+        rcl_init_options_t init_opts = rcl_get_zero_initialized_init_options();
+        if (rcl_init_options_init(&init_opts, site_allocator(opts, "subscriber context")) != RCL_RET_OK) {
+            RCUTILS_LOG_ERROR("rcl_init_options_init: %s", rcutils_get_error_string().str);
+            return;
+        }
+        rcl_ret_t rc = rcl_init(0, nullptr, &init_opts, &sub_context);
+        if (rcl_init_options_fini(&init_opts) != RCL_RET_OK) {
+            RCUTILS_LOG_ERROR("rcl_init_options_fini: %s", rcutils_get_error_string().str);
+        }
+        if (rc != RCL_RET_OK) {
+            RCUTILS_LOG_ERROR("rcl_init of the subscriber context: %s", rcutils_get_error_string().str);
+            return;
+        }
+    }
 
-                if (msg.data.size >= sizeof(uint32_t) + sizeof(int64_t)) {
-                    int64_t send_timestamp;
-                    memcpy(&send_timestamp, msg.data.data + sizeof(uint32_t), sizeof(int64_t));
-                    auto recv_timestamp = std::chrono::steady_clock::now().time_since_epoch().count();
-                    double latency_ms = (recv_timestamp - send_timestamp) / 1e6;
-                    latency_sum2 += latency_ms;
-                    latency_count2++;
+    auto fini_sub_context = [&]() {
+        if (!separate) return;
+        if (rcl_shutdown(&sub_context) != RCL_RET_OK) {
+            RCUTILS_LOG_ERROR("rcl_shutdown: %s", rcutils_get_error_string().str);
+        }
+        if (rcl_context_fini(&sub_context) != RCL_RET_OK) {
+            RCUTILS_LOG_ERROR("rcl_context_fini: %s", rcutils_get_error_string().str);
+        }
+    };
+
+    rcl_node_t sub_node = rcl_get_zero_initialized_node();
+    rcl_node_options_t node_opts = rcl_node_get_default_options();
+    node_opts.allocator = site_allocator(opts, "subscriber node");
+    if (rcl_node_init(&sub_node, "dual_pubsub_rcl_sub_node", "", separate ? &sub_context : context, &node_opts) !=
+        RCL_RET_OK) {
+        RCUTILS_LOG_ERROR("rcl_node_init of the subscriber node: %s", rcutils_get_error_string().str);
+        fini_sub_context();
+        return;
+    }
+    RCUTILS_LOG_INFO("Loopback: subscriber on %s context", separate ? "a separate" : "the publisher's");
+
+    // The subscriber outlives the publisher by a short drain so the last samples in flight are not lost. It is
+    // left unpinned: sharing the publisher's CPUs at the same FIFO priority, it would only run when the
+    // publisher blocks.
+    Options sub_opts = opts;
+    sub_opts.duration = 0.0;
+    sub_opts.placement = demo::ThreadPlacement();
+    std::atomic<bool> sub_stop(false);
+    std::thread subscriber(run_dual_subscriber, &sub_node, std::cref(sub_opts), trace, &sub_stop);
+
+    run_dual_publisher(pub_node, opts, trace);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    sub_stop.store(true);
+    subscriber.join();
+
+    if (rcl_node_fini(&sub_node) != RCL_RET_OK) {
+        RCUTILS_LOG_ERROR("rcl_node_fini: %s", rcutils_get_error_string().str);
+    }
+    fini_sub_context();
+}
+
+// --mode startup: one publisher or subscription of the generated graph and when it passed each startup stage, in
+// ns since process start; 0 until it does
+struct StartupEntity {
+    size_t node = 0;
+    std::string topic;
+    rcl_publisher_t publisher = rcl_get_zero_initialized_publisher();
+    rcl_subscription_t subscription = rcl_get_zero_initialized_subscription();
+    int64_t created = 0;
+    int64_t matched = 0;
+    int64_t first_sample = 0;
+};
+
+// "<n>/<expected>, <distribution>" of one stage over all entities that reached it
+std::string format_stage(const demo::LatencyHistogram &stage, size_t expected) {
+    return std::to_string(stage.count()) + "/" + std::to_string(expected) + ", " + demo::format_latency_ms(stage);
+}
+
+// Cold start of a graph of --graph-nodes nodes with --graph-topics topics each. Every stage, from rcl_init to the
+// first sample of every subscription, is timed from process start, so a run against a fresh rmw_zenohd shows
+// where startup time goes and how discovery scales. Publishers send a sample every 100 ms, so a subscription
+// that matches late still gets one; the run ends once every subscription has, or after --duration.
+void run_startup(rcl_context_t *context, const Options &opts, int64_t start_ns, int64_t init_ns) {
+    bool publish = opts.graph_role != "sub";
+    bool subscribe = opts.graph_role != "pub";
+    rmw_qos_profile_t qos = rmw_qos_profile_default;
+    std::string error;
+    demo::parse_qos(opts.graph_qos, qos, error);
+    const rosidl_message_type_support_t *ts = ROSIDL_GET_MSG_TYPE_SUPPORT(std_msgs, msg, UInt8MultiArray);
+    RCUTILS_LOG_INFO("Startup: %zu nodes x %zu topics as %s, QoS %s", opts.graph_nodes, opts.graph_topics,
+                     opts.graph_role.c_str(), demo::format_qos(qos).c_str());
+
+    std::vector<rcl_node_t> nodes(opts.graph_nodes, rcl_get_zero_initialized_node());
+    // Reserved up front: the wait set and the rmw hold on to the handles' addresses
+    std::vector<StartupEntity> publishers;
+    std::vector<StartupEntity> subscriptions;
+    publishers.reserve(publish ? opts.graph_nodes * opts.graph_topics : 0);
+    subscriptions.reserve(subscribe ? opts.graph_nodes * opts.graph_topics : 0);
+    demo::LatencyHistogram node_stage, publisher_stage, subscription_stage;
+    size_t nodes_initialized = 0;
+    bool ok = true;
+    for (size_t i = 0; ok && i < nodes.size(); ++i) {
+        std::string name = "startup_" + opts.graph_role + "_" + std::to_string(i);
+        rcl_node_options_t node_opts = rcl_node_get_default_options();
+        if (rcl_node_init(&nodes[i], name.c_str(), "", context, &node_opts) != RCL_RET_OK) {
+            RCUTILS_LOG_ERROR("rcl_node_init %s: %s", name.c_str(), rcutils_get_error_string().str);
+            ok = false;
+            break;
+        }
+        nodes_initialized++;
+        node_stage.record(demo::steady_now_ns() - start_ns);
+
+        for (size_t j = 0; ok && j < opts.graph_topics; ++j) {
+            StartupEntity entity;
+            entity.node = i;
+            entity.topic = "startup/n" + std::to_string(i) + "/t" + std::to_string(j);
+            if (publish) {
+                publishers.push_back(entity);
+                StartupEntity &pub = publishers.back();
+                rcl_publisher_options_t pub_opts = rcl_publisher_get_default_options();
+                pub_opts.qos = qos;
+                if (rcl_publisher_init(&pub.publisher, &nodes[i], ts, pub.topic.c_str(), &pub_opts) != RCL_RET_OK) {
+                    RCUTILS_LOG_ERROR("Failed to init publisher %s: %s", pub.topic.c_str(),
+                                      rcutils_get_error_string().str);
+                    publishers.pop_back();
+                    ok = false;
+                    break;
                 }
+                pub.created = demo::steady_now_ns() - start_ns;
+                publisher_stage.record(pub.created);
+            }
+            if (subscribe) {
+                subscriptions.push_back(entity);
+                StartupEntity &sub = subscriptions.back();
+                rcl_subscription_options_t sub_opts = rcl_subscription_get_default_options();
+                sub_opts.qos = qos;
+                if (rcl_subscription_init(&sub.subscription, &nodes[i], ts, sub.topic.c_str(), &sub_opts) !=
+                    RCL_RET_OK) {
+                    RCUTILS_LOG_ERROR("Failed to init subscription %s: %s", sub.topic.c_str(),
+                                      rcutils_get_error_string().str);
+                    subscriptions.pop_back();
+                    ok = false;
+                    break;
+                }
+                sub.created = demo::steady_now_ns() - start_ns;
+                subscription_stage.record(sub.created);
             }
-            std_msgs__msg__UInt8MultiArray__fini(&msg);
         }
     }
+    int64_t graph_ns = demo::steady_now_ns() - start_ns;
 
-    RCUTILS_LOG_INFO("Received %d messages from %s and %d messages from %s",
-                     count1, topic1.c_str(), count2, topic2.c_str());
+    rcl_wait_set_t wait_set = rcl_get_zero_initialized_wait_set();
+    bool wait_set_ready = ok && rcl_wait_set_init(&wait_set, subscriptions.size(), 0, 0, 0, 0, 0, context,
+                                                  rcl_get_default_allocator()) == RCL_RET_OK;
+    if (ok && !wait_set_ready) {
+        RCUTILS_LOG_ERROR("rcl_wait_set_init: %s", rcutils_get_error_string().str);
+        ok = false;
+    }
 
-    if (rcl_wait_set_fini(&wait_set) != RCL_RET_OK) {
+    // Matching is polled every pass, which at 10 ms per wait is well below the discovery times being measured
+    demo::LatencyHistogram match_stage, discovery, first_sample_stage, first_sample_delay;
+    std::vector<uint8_t> base(sizeof(uint32_t) + sizeof(int64_t));
+    std_msgs__msg__UInt8MultiArray msg = create_message(base, base.size(), SampleHeader{0, false, 0});
+    uint32_t round = 0;
+    size_t matched = 0;
+    size_t sampled = 0;
+    int64_t deadline = demo::steady_now_ns() + static_cast<int64_t>(opts.duration * 1e9);
+    int64_t next_publish = demo::steady_now_ns();
+    int64_t last_status = next_publish;
+    size_t expected_matches = publishers.size() + subscriptions.size();
+    while (ok && !g_interrupted.load() && (opts.duration <= 0.0 || demo::steady_now_ns() < deadline)) {
+        if (subscribe && sampled == subscriptions.size()) break;
+        int64_t now = demo::steady_now_ns();
+        auto poll_match = [&](StartupEntity &entity, bool is_publisher) {
+            if (entity.matched) return;
+            size_t count = 0;
+            rcl_ret_t ret = is_publisher ? rcl_publisher_get_subscription_count(&entity.publisher, &count)
+                                         : rcl_subscription_get_publisher_count(&entity.subscription, &count);
+            if (ret != RCL_RET_OK) {
+                rcutils_reset_error();
+            } else if (count > 0) {
+                entity.matched = now - start_ns;
+                match_stage.record(entity.matched);
+                discovery.record(entity.matched - entity.created);
+                matched++;
+            }
+        };
+        for (auto &pub : publishers) {
+            poll_match(pub, true);
+        }
+        for (auto &sub : subscriptions) {
+            poll_match(sub, false);
+        }
+
+        if (publish && now >= next_publish) {
+            SampleHeader header{round++, false, 0};
+            write_header(msg.data.data, msg.data.size, header);
+            for (auto &pub : publishers) {
+                if (rcl_publish(&pub.publisher, &msg, nullptr) != RCL_RET_OK) {
+                    RCUTILS_LOG_ERROR("rcl_publish %s: %s", pub.topic.c_str(), rcutils_get_error_string().str);
+                    rcutils_reset_error();
+                }
+            }
+            next_publish += RCL_MS_TO_NS(100);
+        }
+
+        if (now - last_status >= 1000000000) {
+            RCUTILS_LOG_INFO("Startup: %.1f s, %zu/%zu matched, %zu/%zu first samples", (now - start_ns) / 1e9,
+                             matched, expected_matches, sampled, subscriptions.size());
+            last_status = now;
+        }
+
+        if (!subscribe) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        if (rcl_wait_set_clear(&wait_set) != RCL_RET_OK) break;
+        for (auto &sub : subscriptions) {
+            if (rcl_wait_set_add_subscription(&wait_set, &sub.subscription, nullptr) != RCL_RET_OK) {
+                RCUTILS_LOG_ERROR("rcl_wait_set_add_subscription %s: %s", sub.topic.c_str(),
+                                  rcutils_get_error_string().str);
+                ok = false;
+                break;
+            }
+        }
+        if (!ok || rcl_wait(&wait_set, RCL_MS_TO_NS(10)) == RCL_RET_TIMEOUT) continue;
+        for (size_t i = 0; i < subscriptions.size(); ++i) {
+            if (wait_set.subscriptions[i] != &subscriptions[i].subscription) continue;
+            StartupEntity &sub = subscriptions[i];
+            std_msgs__msg__UInt8MultiArray sample;
+            std_msgs__msg__UInt8MultiArray__init(&sample);
+            if (rcl_take(&sub.subscription, &sample, nullptr, nullptr) == RCL_RET_OK && !sub.first_sample) {
+                sub.first_sample = demo::steady_now_ns() - start_ns;
+                first_sample_stage.record(sub.first_sample);
+                first_sample_delay.record(sub.first_sample - sub.created);
+                sampled++;
+            }
+            std_msgs__msg__UInt8MultiArray__fini(&sample);
+        }
+    }
+    std_msgs__msg__UInt8MultiArray__fini(&msg);
+
+    RCUTILS_LOG_INFO("Startup over run, times since process start:");
+    RCUTILS_LOG_INFO("  rcl_init: %.2f ms", init_ns / 1e6);
+    RCUTILS_LOG_INFO("  node init: %s", format_stage(node_stage, nodes.size()).c_str());
+    if (publish) {
+        RCUTILS_LOG_INFO("  publisher created: %s",
+                         format_stage(publisher_stage, nodes.size() * opts.graph_topics).c_str());
+    }
+    if (subscribe) {
+        RCUTILS_LOG_INFO("  subscription created: %s",
+                         format_stage(subscription_stage, nodes.size() * opts.graph_topics).c_str());
+    }
+    RCUTILS_LOG_INFO("  graph created: %.2f ms", graph_ns / 1e6);
+    RCUTILS_LOG_INFO("  first match: %s", format_stage(match_stage, expected_matches).c_str());
+    if (subscribe) {
+        RCUTILS_LOG_INFO("  first sample: %s", format_stage(first_sample_stage, subscriptions.size()).c_str());
+    }
+    RCUTILS_LOG_INFO("Startup over run, times since each entity was created:");
+    RCUTILS_LOG_INFO("  first match: %s", format_stage(discovery, expected_matches).c_str());
+    if (subscribe) {
+        RCUTILS_LOG_INFO("  first sample: %s", format_stage(first_sample_delay, subscriptions.size()).c_str());
+    }
+
+    int64_t teardown_start = demo::steady_now_ns();
+    if (wait_set_ready && rcl_wait_set_fini(&wait_set) != RCL_RET_OK) {
         RCUTILS_LOG_ERROR("rcl_wait_set_fini: %s", rcutils_get_error_string().str);
     }
-    if (rcl_subscription_fini(&subscription1, node) != RCL_RET_OK) {
-        RCUTILS_LOG_ERROR("rcl_subscription_fini subscription1: %s", rcutils_get_error_string().str);
+    for (auto &pub : publishers) {
+        if (rcl_publisher_fini(&pub.publisher, &nodes[pub.node]) != RCL_RET_OK) {
+            RCUTILS_LOG_ERROR("rcl_publisher_fini %s: %s", pub.topic.c_str(), rcutils_get_error_string().str);
+        }
     }
-    if (rcl_subscription_fini(&subscription2, node) != RCL_RET_OK) {
-        RCUTILS_LOG_ERROR("rcl_subscription_fini subscription2: %s", rcutils_get_error_string().str);
+    for (auto &sub : subscriptions) {
+        if (rcl_subscription_fini(&sub.subscription, &nodes[sub.node]) != RCL_RET_OK) {
+            RCUTILS_LOG_ERROR("rcl_subscription_fini %s: %s", sub.topic.c_str(), rcutils_get_error_string().str);
+        }
     }
+    for (size_t i = 0; i < nodes_initialized; ++i) {
+        if (rcl_node_fini(&nodes[i]) != RCL_RET_OK) {
+            RCUTILS_LOG_ERROR("rcl_node_fini: %s", rcutils_get_error_string().str);
+        }
+    }
+    RCUTILS_LOG_INFO("  teardown: %.2f ms", (demo::steady_now_ns() - teardown_start) / 1e6);
 }
 
 int main(int argc, char *argv[]) {
+    std::signal(SIGINT, handle_sigint);
+
+    // --mode startup times everything from here
+    int64_t start_ns = demo::steady_now_ns();
+    // Parsed before rcl_init, which already takes the --rcl-alloc allocator
+    Options opts;
+    if (!parse_args(argc, argv, opts)) {
+        return 1;
+    }
+    // Never freed: rcl and the rmw may release blocks through these allocators until the process exits
+    if (opts.rcl_alloc != "default") {
+        opts.allocators = new demo::AllocatorRegistry(opts.rcl_alloc == "arena");
+    }
+
     rcl_ret_t rc;
     rcl_context_t context = rcl_get_zero_initialized_context();
     rcl_init_options_t init_opts = rcl_get_zero_initialized_init_options();
-    rc = rcl_init_options_init(&init_opts, rcl_get_default_allocator());
+    rc = rcl_init_options_init(&init_opts, site_allocator(opts, "context"));
     rc = rcl_init(argc, argv, &init_opts, &context);
+    int64_t init_ns = demo::steady_now_ns() - start_ns;
 
+    // --mode startup creates only its generated graph, so the first node it times really is the first
+    bool startup = opts.mode == "startup";
     rcl_node_t node = rcl_get_zero_initialized_node();
-    rcl_node_options_t node_opts = rcl_node_get_default_options();
-    rc = rcl_node_init(&node, "dual_pubsub_rcl_node", "", &context, &node_opts);
+    if (!startup) {
+        rcl_node_options_t node_opts = rcl_node_get_default_options();
+        node_opts.allocator = site_allocator(opts, "node");
+        rc = rcl_node_init(&node, "dual_pubsub_rcl_node", "", &context, &node_opts);
+    }
 
-    std::string mode, topic1, topic2;
-    double duration, rate1, rate2;
-    size_t payload1, payload2;
-    if (!parse_args(argc, argv, mode, topic1, topic2, duration, rate1, rate2, payload1, payload2)) {
-        if (rcl_shutdown(&context) != RCL_RET_OK) {
-            RCUTILS_LOG_ERROR("rcl_shutdown: %s", rcutils_get_error_string().str);
-            return -1;
+    if (opts.serialized) {
+        RCUTILS_LOG_INFO("Serialized mode: payloads are read from and written to CDR buffers directly");
+    } else if (opts.alloc == "pool" && opts.mode != "sub" && opts.mode != "parallel_sub") {
+        RCUTILS_LOG_INFO("Message allocation: pool of %zu buffers per publisher", opts.pool_depth);
+    }
+
+    if (opts.mlockall) {
+        std::string error;
+        if (demo::lock_all_memory(error)) {
+            RCUTILS_LOG_INFO("Memory locked with mlockall");
+        } else {
+            RCUTILS_LOG_ERROR("--mlockall: %s", error.c_str());
         }
-        return 1;
     }
 
-    if (mode == "pub") {
-        run_dual_publisher(&node, topic1, topic2, duration, rate1, rate2, payload1, payload2);
-    } else if (mode == "parallel_pub") {
-        run_parallel_publisher(&node, topic1, topic2, duration, rate1, rate2, payload1, payload2);
+    bool is_subscriber = opts.mode == "sub" || opts.mode == "parallel_sub";
+    const char *trace_role = opts.mode == "loopback" ? "loop" : is_subscriber ? "sub" : "pub";
+    demo::TraceWriter trace;
+    if (!opts.trace_out.empty()) {
+        std::vector<std::string> names;
+        for (const auto &spec : opts.streams) {
+            names.push_back(spec.name);
+        }
+        std::string error;
+        if (!trace.open(opts.trace_out, opts.trace_records, trace_role, names, error)) {
+            RCUTILS_LOG_ERROR("--trace-out: %s", error.c_str());
+        }
+    }
+    demo::TraceWriter *trace_ptr = trace.is_open() ? &trace : nullptr;
+
+    std::atomic<bool> monitor_stop(false);
+    std::thread monitor;
+    if (opts.resources) {
+        monitor = std::thread(run_resource_monitor, std::cref(monitor_stop));
+    }
+
+    // Service calls run next to the topics, so their round trips are measured while the streams load the link
+    std::atomic<bool> rpc_stop(false);
+    std::vector<std::thread> rpc_threads;
+    if (!opts.rpc.kind.empty()) {
+        if (is_subscriber || opts.mode == "loopback") {
+            rpc_threads.emplace_back(run_rpc, &node, std::cref(opts), true, std::cref(rpc_stop));
+        }
+        if (!is_subscriber) {
+            rpc_threads.emplace_back(run_rpc, &node, std::cref(opts), false, std::cref(rpc_stop));
+        }
+    }
+
+    if (opts.mode == "pub") {
+        run_dual_publisher(&node, opts, trace_ptr);
+    } else if (opts.mode == "parallel_pub") {
+        run_parallel_publisher(&node, opts, trace_ptr);
+    } else if (opts.mode == "parallel_sub") {
+        run_parallel_subscriber(&node, opts, trace_ptr);
+    } else if (opts.mode == "loopback") {
+        run_loopback(&context, &node, opts, trace_ptr);
+    } else if (startup) {
+        run_startup(&context, opts, start_ns, init_ns);
     } else {
-        run_dual_subscriber(&node, topic1, topic2, duration);
+        run_dual_subscriber(&node, opts, trace_ptr, nullptr);
+    }
+
+    rpc_stop.store(true);
+    for (auto &thread : rpc_threads) {
+        thread.join();
+    }
+    if (monitor.joinable()) {
+        monitor_stop.store(true);
+        monitor.join();
     }
 
-    if (rcl_node_fini(&node) != RCL_RET_OK) {
+    if (trace.is_open()) {
+        uint64_t kept = std::min(trace.written(), trace.capacity());
+        RCUTILS_LOG_INFO("Traced %llu records to %s%s", static_cast<unsigned long long>(kept), opts.trace_out.c_str(),
+                         kept < trace.written() ? " (ring wrapped, oldest records overwritten)" : "");
+        trace.close();
+    }
+
+    if (!startup && rcl_node_fini(&node) != RCL_RET_OK) {
         RCUTILS_LOG_ERROR("rcl_node_fini: %s", rcutils_get_error_string().str);
         return -1;
     }
@@ -548,5 +2452,12 @@ int main(int argc, char *argv[]) {
         RCUTILS_LOG_ERROR("rcl_shutdown: %s", rcutils_get_error_string().str);
         return -1;
     }
+
+    // After shutdown, so live bytes are what rcl and the rmw still hold
+    if (opts.allocators) {
+        for (const auto &line : opts.allocators->format_summary()) {
+            RCUTILS_LOG_INFO("rcl allocations over run at %s", line.c_str());
+        }
+    }
     return 0;
 }
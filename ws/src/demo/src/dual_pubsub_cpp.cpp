@@ -1,4 +1,5 @@
 #include <getopt.h>
+#include <algorithm>
 #include <chrono>
 #include <cstdio>
 #include <cstdlib>
@@ -6,6 +7,7 @@
 #include <iostream>
 #include <iomanip>
 #include <limits>
+#include <sstream>
 #include <string>
 #include <thread>
 #include <vector>
@@ -13,30 +15,120 @@
 #include <atomic>
 #include <memory>
 
+#include <rclcpp/experimental/executors/events_executor/events_executor.hpp>
 #include <rclcpp/rclcpp.hpp>
+#include <example_interfaces/srv/add_two_ints.hpp>
 #include <std_msgs/msg/u_int8_multi_array.hpp>
 
-using std::placeholders::_1;
+#include "demo/srv/payload.hpp"
+
+#include "demo/deadline_scheduler.hpp"
+#include "demo/echo.hpp"
+#include "demo/latency_histogram.hpp"
+#include "demo/payload_content.hpp"
+#include "demo/resource_usage.hpp"
+#include "demo/rpc.hpp"
+#include "demo/sequence_tracker.hpp"
+#include "demo/stats_shard.hpp"
+#include "demo/stream_spec.hpp"
+
+struct Options {
+    std::string mode = "sub";
+    std::vector<demo::StreamSpec> streams;
+    double duration = 3.0;
+    // Empty until parsed; defaults to multi when --threads is above 1
+    std::string executor;
+    // 0 until resolved: every hardware thread for the multi executor, 1 for the others
+    int num_threads = 0;
+    std::string callback_groups = "per_topic";
+    bool echo = false;
+    bool resources = false;
+    // --rpc: no service calls when kind is empty
+    demo::RpcSpec rpc;
+};
+
+// The --rpc services, stamped and checked as in dual_pubsub: the client puts its send time in the request and the
+// server hands it back, so a reply is matched against the call it answers
+void init_request(example_interfaces::srv::AddTwoInts::Request &request, const demo::RpcSpec &) { request.b = 1; }
+
+void stamp_request(example_interfaces::srv::AddTwoInts::Request &request, int64_t sent_ns) { request.a = sent_ns; }
+
+bool check_response(const example_interfaces::srv::AddTwoInts::Response &response, int64_t sent_ns,
+                    const demo::RpcSpec &) {
+    return response.sum == sent_ns + 1;
+}
+
+void serve_request(const example_interfaces::srv::AddTwoInts::Request &request,
+                   example_interfaces::srv::AddTwoInts::Response &response, std::vector<uint8_t> &) {
+    response.sum = request.a + request.b;
+}
+
+// Random bytes, so a compressing transport does not shrink the calls
+void init_request(demo::srv::Payload::Request &request, const demo::RpcSpec &spec) {
+    request.data.resize(spec.request_size);
+    demo::fill_random(request.data.data(), request.data.size(), 0);
+    request.response_size = static_cast<uint32_t>(spec.response_size);
+}
+
+void stamp_request(demo::srv::Payload::Request &request, int64_t sent_ns) {
+    if (!request.data.empty()) {
+        std::memcpy(request.data.data(), &sent_ns, std::min(sizeof(sent_ns), request.data.size()));
+    }
+}
+
+bool check_response(const demo::srv::Payload::Response &response, int64_t sent_ns, const demo::RpcSpec &spec) {
+    if (response.data.size() != spec.response_size) return false;
+    return response.data.empty() ||
+           std::memcmp(response.data.data(), &sent_ns, std::min(sizeof(sent_ns), response.data.size())) == 0;
+}
+
+// base holds random bytes generated once for the largest response asked for so far
+void serve_request(const demo::srv::Payload::Request &request, demo::srv::Payload::Response &response,
+                   std::vector<uint8_t> &base) {
+    if (base.size() < request.response_size) {
+        base.resize(request.response_size);
+        demo::fill_random(base.data(), base.size(), 1);
+    }
+    response.data.assign(base.begin(), base.begin() + request.response_size);
+    std::size_t stamp = std::min({sizeof(int64_t), request.data.size(), response.data.size()});
+    if (stamp > 0) std::memcpy(response.data.data(), request.data.data(), stamp);
+}
 
 class DualPubSubNode : public rclcpp::Node {
 public:
-    DualPubSubNode(const std::string &mode, const std::string &topic1_name, const std::string &topic2_name,
-                   double duration, double rate1, double rate2, std::size_t payload1, std::size_t payload2)
+    explicit DualPubSubNode(const Options &opts)
         : Node("dual_pubsub_cpp_node"),
-          mode_(mode),
-          topic1_name_(topic1_name),
-          topic2_name_(topic2_name),
-          duration_(duration),
-          rate1_(rate1),
-          rate2_(rate2),
-          payload1_(payload1),
-          payload2_(payload2),
-          finished_(false),
-          count1_(0),
-          count2_(0),
-          msg_id1_(0),
-          msg_id2_(0) {
-        
+          mode_(opts.mode),
+          duration_(opts.duration),
+          echo_(opts.echo),
+          rpc_(opts.rpc),
+          finished_(false) {
+        // With per-topic groups a slow callback on one stream cannot hold up another stream or the status
+        // line; with the default group every callback of the node is serialized
+        bool per_topic = opts.callback_groups == "per_topic";
+        if (per_topic) {
+            control_group_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+            rpc_group_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+        }
+        for (const auto &spec : opts.streams) {
+            auto stream = std::make_unique<Stream>(opts.num_threads);
+            stream->spec = spec;
+            if (per_topic) {
+                stream->callback_group = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+            }
+            streams_.push_back(std::move(stream));
+        }
+
+        if (opts.resources) {
+            resource_monitors_.emplace_back("self", 0);
+            pid_t router = demo::find_process("rmw_zenohd");
+            if (router) {
+                resource_monitors_.emplace_back("rmw_zenohd", router);
+            } else {
+                RCLCPP_INFO(this->get_logger(), "Resources: no rmw_zenohd on this host, sampling this process only");
+            }
+        }
+
         if (mode_ == "pub") {
             setup_dual_publisher();
         } else if (mode_ == "parallel_pub") {
@@ -44,75 +136,133 @@ public:
         } else {
             setup_dual_subscriber();
         }
+
+        // Service calls run next to the topics, so their round trips are measured while the streams load the link
+        if (rpc_.kind == "payload") {
+            setup_rpc<demo::srv::Payload>();
+        } else if (!rpc_.kind.empty()) {
+            setup_rpc<example_interfaces::srv::AddTwoInts>();
+        }
+    }
+
+    // Whole-run latency and loss, printed once the executor has stopped spinning
+    void print_subscriber_summary() {
+        if (mode_ != "sub") return;
+        for (auto &stream : streams_) {
+            stream->stats.drain_latency(stream->latency);
+            stream->latency_total.merge(stream->latency);
+            stream->latency.reset();
+            std::cout << stream->spec.name << " over run: " << demo::format_latency_ms(stream->latency_total) << ", "
+                      << demo::format_loss(stream->sequence_snapshot.load()) << std::endl;
+        }
+    }
+
+    // Whole-run round trips or calls served, with --rpc
+    void print_rpc_summary() {
+        if (rpc_.kind.empty()) return;
+        std::string name = demo::rpc_service_name(rpc_);
+        if (rpc_service_) {
+            RCLCPP_INFO(this->get_logger(), "RPC: %s served %zu calls over run", name.c_str(), rpc_served_.load());
+        } else {
+            std::lock_guard<std::mutex> lock(rpc_mutex_);
+            RCLCPP_INFO(this->get_logger(), "RPC: %s over run: %s", name.c_str(), rpc_stats_.format_summary().c_str());
+        }
+    }
+
+    // Whole-run resource use, with --resources
+    void print_resource_summary() {
+        for (const auto &monitor : resource_monitors_) {
+            RCLCPP_INFO(this->get_logger(), "Resources over run: %s", monitor.format_summary().c_str());
+        }
     }
 
 private:
+    // Everything one topic stream owns on either side
+    struct Stream {
+        explicit Stream(int num_threads) : stats(static_cast<size_t>(num_threads)) {}
+
+        demo::StreamSpec spec;
+        // Null for the node's default group. Mutually exclusive, so the stream's callbacks never overlap.
+        rclcpp::CallbackGroup::SharedPtr callback_group;
+        rclcpp::Publisher<std_msgs::msg::UInt8MultiArray>::SharedPtr publisher;
+        rclcpp::Subscription<std_msgs::msg::UInt8MultiArray>::SharedPtr subscription;
+        rclcpp::TimerBase::SharedPtr timer;
+        // Publisher payload, generated once; every message is a copy with its header rewritten
+        std::vector<uint8_t> base;
+
+        std::atomic<size_t> count{0};
+        std::atomic<uint32_t> msg_id{0};
+        size_t count_last_status = 0;
+
+        // Subscriber statistics. Callbacks write the shard of their executor thread; the status timer drains
+        // the shards into latency and folds that into the whole-run histogram at every status line.
+        demo::ShardedStats stats;
+        demo::LatencyHistogram latency;
+        demo::LatencyHistogram latency_total;
+        // Ids are tracked in arrival order, which needs the stream's callbacks to be serialized; the timer
+        // only reads the snapshot
+        demo::SequenceTracker sequence;
+        demo::AtomicSequenceStats sequence_snapshot;
+        demo::SequenceStats sequence_last_second;
+
+        // --echo: the subscriber answers on <name>/echo, the publisher times the round trips
+        rclcpp::Publisher<std_msgs::msg::UInt8MultiArray>::SharedPtr echo_publisher;
+        rclcpp::Subscription<std_msgs::msg::UInt8MultiArray>::SharedPtr echo_subscription;
+        std_msgs::msg::UInt8MultiArray echo_reply;
+        // Guards the publisher-side echo statistics, which the status timer reads from another group
+        std::mutex echo_mutex;
+        size_t echo_count = 0;
+        demo::EchoStats echo_stats;
+    };
+
     std::string mode_;
-    std::string topic1_name_;
-    std::string topic2_name_;
     double duration_;
-    double rate1_;
-    double rate2_;
-    std::size_t payload1_;
-    std::size_t payload2_;
-    bool finished_;
-    
-    std::atomic<size_t> count1_;
-    std::atomic<size_t> count2_;
-    std::atomic<uint32_t> msg_id1_;
-    std::atomic<uint32_t> msg_id2_;
-    
-    // Publisher components
-    rclcpp::Publisher<std_msgs::msg::UInt8MultiArray>::SharedPtr publisher1_;
-    rclcpp::Publisher<std_msgs::msg::UInt8MultiArray>::SharedPtr publisher2_;
-    rclcpp::TimerBase::SharedPtr timer1_;
-    rclcpp::TimerBase::SharedPtr timer2_;
+    bool echo_;
+    demo::RpcSpec rpc_;
+    std::atomic<bool> finished_;
+
+    std::vector<std::unique_ptr<Stream>> streams_;
+    // --resources: this process and a local rmw_zenohd, sampled by the status timer
+    std::vector<demo::ResourceMonitor> resource_monitors_;
+    // Status and duration timers; null for the node's default group
+    rclcpp::CallbackGroup::SharedPtr control_group_;
     rclcpp::TimerBase::SharedPtr status_timer_;
-    
-    // Subscriber components
-    rclcpp::Subscription<std_msgs::msg::UInt8MultiArray>::SharedPtr subscription1_;
-    rclcpp::Subscription<std_msgs::msg::UInt8MultiArray>::SharedPtr subscription2_;
-    
-    // Statistics for subscriber
+    rclcpp::TimerBase::SharedPtr duration_timer_;
+
+    // --rpc: the server in sub mode, the client and its call timer otherwise. Null group for the node's default.
+    rclcpp::CallbackGroup::SharedPtr rpc_group_;
+    rclcpp::ServiceBase::SharedPtr rpc_service_;
+    rclcpp::ClientBase::SharedPtr rpc_client_;
+    rclcpp::TimerBase::SharedPtr rpc_timer_;
+    std::vector<uint8_t> rpc_response_base_;
+    std::atomic<size_t> rpc_served_{0};
+    size_t rpc_served_last_ = 0;
+    // Guards the client statistics, which response callbacks and the status timer share
+    std::mutex rpc_mutex_;
+    demo::RpcStats rpc_stats_;
+
     std::chrono::steady_clock::time_point start_time_;
     std::chrono::steady_clock::time_point last_status_time_;
-    size_t count1_last_status_;
-    size_t count2_last_status_;
-    double latency_sum1_;
-    double latency_sum2_;
-    uint32_t latency_count1_;
-    uint32_t latency_count2_;
-    double latency_sum1_last_second_;
-    double latency_sum2_last_second_;
-    uint32_t latency_count1_last_second_;
-    uint32_t latency_count2_last_second_;
-    size_t payload_size1_;
-    size_t payload_size2_;
-    uint32_t first_msg_id1_;
-    uint32_t first_msg_id2_;
-    uint32_t last_msg_id1_;
-    uint32_t last_msg_id2_;
-    uint32_t missed_events1_;
-    uint32_t missed_events2_;
-    bool first_msg1_;
-    bool first_msg2_;
-    
-    std_msgs::msg::UInt8MultiArray create_message(size_t payload, uint8_t fill_byte, uint32_t msg_id) {
+
+    std_msgs::msg::UInt8MultiArray create_message(const std::vector<uint8_t> &base, uint32_t msg_id) {
         auto msg = std_msgs::msg::UInt8MultiArray();
-        msg.data.resize(payload, fill_byte);
-        
+        msg.data = base;
+        size_t payload = base.size();
+
         // Set message ID
-        std::memcpy(msg.data.data(), &msg_id, sizeof(uint32_t));
-        
+        if (payload >= sizeof(uint32_t)) {
+            std::memcpy(msg.data.data(), &msg_id, sizeof(uint32_t));
+        }
+
         // Set timestamp
         auto timestamp = std::chrono::steady_clock::now().time_since_epoch().count();
         if (payload >= sizeof(uint32_t) + sizeof(int64_t)) {
             std::memcpy(msg.data.data() + sizeof(uint32_t), &timestamp, sizeof(int64_t));
         }
-        
+
         return msg;
     }
-    
+
     std::string format_bytes(size_t bytes) {
         if (bytes >= 1024 * 1024 * 1024) {
             return std::to_string(bytes / (1024 * 1024 * 1024)) + " GB";
@@ -124,106 +274,159 @@ private:
             return std::to_string(bytes) + " B";
         }
     }
-    
+
+    rclcpp::QoS stream_qos(const demo::StreamSpec &spec) {
+        rmw_qos_profile_t profile = demo::stream_qos_profile(spec);
+        return rclcpp::QoS(rclcpp::QoSInitialization::from_rmw(profile), profile);
+    }
+
+    rclcpp::SubscriptionOptions stream_options(const Stream &stream) {
+        rclcpp::SubscriptionOptions options;
+        options.callback_group = stream.callback_group;
+        return options;
+    }
+
     void setup_dual_publisher() {
-        publisher1_ = this->create_publisher<std_msgs::msg::UInt8MultiArray>(topic1_name_, 10);
-        publisher2_ = this->create_publisher<std_msgs::msg::UInt8MultiArray>(topic2_name_, 10);
-        
-        auto period1 = std::chrono::milliseconds(static_cast<int>(1000.0 / rate1_));
-        auto period2 = std::chrono::milliseconds(static_cast<int>(1000.0 / rate2_));
-        
-        timer1_ = this->create_wall_timer(period1, std::bind(&DualPubSubNode::publish_topic1, this));
-        timer2_ = this->create_wall_timer(period2, std::bind(&DualPubSubNode::publish_topic2, this));
-        
+        std::string description;
+        for (auto &stream : streams_) {
+            Stream *s = stream.get();
+            std::string error;
+            if (!demo::make_payload_content(s->spec.content, s->spec.payload, s->spec.fill_byte,
+                                            &stream - streams_.data(), s->base, error)) {
+                RCLCPP_ERROR(this->get_logger(), "Payload content for %s: %s, sending constant bytes",
+                             s->spec.name.c_str(), error.c_str());
+                s->base.assign(s->spec.payload, s->spec.fill_byte);
+            }
+            s->publisher = this->create_publisher<std_msgs::msg::UInt8MultiArray>(s->spec.name, stream_qos(s->spec));
+            auto period = std::chrono::milliseconds(static_cast<int>(1000.0 / s->spec.rate));
+            s->timer = this->create_wall_timer(period, [this, s]() { publish_stream(*s); }, s->callback_group);
+            RCLCPP_INFO(this->get_logger(), "%s publisher QoS: %s", s->spec.name.c_str(),
+                        demo::format_qos(s->publisher->get_actual_qos().get_rmw_qos_profile()).c_str());
+            if (echo_) {
+                s->echo_subscription = this->create_subscription<std_msgs::msg::UInt8MultiArray>(
+                    demo::echo_topic(s->spec.name), stream_qos(s->spec),
+                    [this, s](const std_msgs::msg::UInt8MultiArray::SharedPtr msg) { on_echo(*s, *msg); },
+                    stream_options(*s));
+            }
+
+            char buf[256];
+            snprintf(buf, sizeof(buf), "%s (%.1f Hz, %zu bytes)", s->spec.name.c_str(), s->spec.rate, s->spec.payload);
+            description += (description.empty() ? "" : ", ") + std::string(buf);
+        }
+
         // Status timer
-        status_timer_ = this->create_wall_timer(std::chrono::seconds(1), 
-                                               std::bind(&DualPubSubNode::print_publisher_status, this));
-        
+        status_timer_ = this->create_wall_timer(std::chrono::seconds(1),
+                                               std::bind(&DualPubSubNode::print_publisher_status, this), control_group_);
+
         start_time_ = std::chrono::steady_clock::now();
         last_status_time_ = start_time_;
-        count1_last_status_ = 0;
-        count2_last_status_ = 0;
-        
-        RCLCPP_INFO(this->get_logger(), "Dual publisher: %s (%.1f Hz, %zu bytes), %s (%.1f Hz, %zu bytes)",
-                    topic1_name_.c_str(), rate1_, payload1_, topic2_name_.c_str(), rate2_, payload2_);
-        
+
+        RCLCPP_INFO(this->get_logger(), "Dual publisher: %s", description.c_str());
+
         if (duration_ > 0.0) {
-            auto duration_timer = this->create_wall_timer(
+            duration_timer_ = this->create_wall_timer(
                 std::chrono::milliseconds(static_cast<int>(duration_ * 1000)),
-                std::bind(&DualPubSubNode::stop_publishing, this));
+                std::bind(&DualPubSubNode::stop_publishing, this), control_group_);
         }
     }
-    
+
     void setup_parallel_publisher() {
         // For parallel_pub mode, we still use the same approach but with separate timers
         // The difference is conceptual - in parallel_pub we emphasize concurrent execution
         setup_dual_publisher();
         RCLCPP_INFO(this->get_logger(), "Parallel publisher mode enabled");
     }
-    
+
     void setup_dual_subscriber() {
-        subscription1_ = this->create_subscription<std_msgs::msg::UInt8MultiArray>(
-            topic1_name_, 10, std::bind(&DualPubSubNode::subscription1_callback, this, _1));
-        subscription2_ = this->create_subscription<std_msgs::msg::UInt8MultiArray>(
-            topic2_name_, 10, std::bind(&DualPubSubNode::subscription2_callback, this, _1));
-        
+        std::string names;
+        for (auto &stream : streams_) {
+            Stream *s = stream.get();
+            s->subscription = this->create_subscription<std_msgs::msg::UInt8MultiArray>(
+                s->spec.name, stream_qos(s->spec),
+                [this, s](const std_msgs::msg::UInt8MultiArray::SharedPtr msg) { on_message(*s, *msg); },
+                stream_options(*s));
+            RCLCPP_INFO(this->get_logger(), "%s subscription QoS: %s", s->spec.name.c_str(),
+                        demo::format_qos(s->subscription->get_actual_qos().get_rmw_qos_profile()).c_str());
+            if (echo_) {
+                s->echo_publisher = this->create_publisher<std_msgs::msg::UInt8MultiArray>(
+                    demo::echo_topic(s->spec.name), stream_qos(s->spec));
+                s->echo_reply.data.resize(demo::kEchoReplySize);
+            }
+            names += (names.empty() ? "" : ", ") + s->spec.name;
+        }
+
         // Status timer
-        status_timer_ = this->create_wall_timer(std::chrono::seconds(1), 
-                                               std::bind(&DualPubSubNode::print_subscriber_status, this));
-        
+        status_timer_ = this->create_wall_timer(std::chrono::seconds(1),
+                                               std::bind(&DualPubSubNode::print_subscriber_status, this), control_group_);
+
         start_time_ = std::chrono::steady_clock::now();
         last_status_time_ = start_time_;
-        count1_last_status_ = 0;
-        count2_last_status_ = 0;
-        latency_sum1_ = 0.0;
-        latency_sum2_ = 0.0;
-        latency_count1_ = 0;
-        latency_count2_ = 0;
-        latency_sum1_last_second_ = 0.0;
-        latency_sum2_last_second_ = 0.0;
-        latency_count1_last_second_ = 0;
-        latency_count2_last_second_ = 0;
-        payload_size1_ = 0;
-        payload_size2_ = 0;
-        first_msg_id1_ = 0;
-        first_msg_id2_ = 0;
-        last_msg_id1_ = 0;
-        last_msg_id2_ = 0;
-        missed_events1_ = 0;
-        missed_events2_ = 0;
-        first_msg1_ = true;
-        first_msg2_ = true;
-        
-        RCLCPP_INFO(this->get_logger(), "Dual subscriber: listening on %s and %s",
-                    topic1_name_.c_str(), topic2_name_.c_str());
-        
+
+        RCLCPP_INFO(this->get_logger(), "Dual subscriber: listening on %s", names.c_str());
+
         if (duration_ > 0.0) {
-            auto duration_timer = this->create_wall_timer(
+            duration_timer_ = this->create_wall_timer(
                 std::chrono::milliseconds(static_cast<int>(duration_ * 1000)),
-                std::bind(&DualPubSubNode::stop_subscribing, this));
+                std::bind(&DualPubSubNode::stop_subscribing, this), control_group_);
         }
     }
-    
-    void publish_topic1() {
-        if (finished_) return;
-        
-        auto now = std::chrono::steady_clock::now();
-        if (duration_ > 0.0) {
-            double elapsed = std::chrono::duration<double>(now - start_time_).count();
-            if (elapsed >= duration_) {
-                stop_publishing();
-                return;
-            }
+
+    template <typename ServiceT>
+    void setup_rpc() {
+        using Request = typename ServiceT::Request;
+        using Response = typename ServiceT::Response;
+        std::string name = demo::rpc_service_name(rpc_);
+        if (mode_ == "sub") {
+            rpc_service_ = this->create_service<ServiceT>(
+                name,
+                [this](const std::shared_ptr<Request> request, std::shared_ptr<Response> response) {
+                    serve_request(*request, *response, rpc_response_base_);
+                    rpc_served_++;
+                },
+                rclcpp::ServicesQoS(), rpc_group_);
+            RCLCPP_INFO(this->get_logger(), "RPC: serving %s", name.c_str());
+            return;
         }
-        
-        auto msg = create_message(payload1_, 0xA1, msg_id1_++);
-        publisher1_->publish(msg);
-        count1_++;
+
+        // Calls go out at a fixed rate whether or not earlier ones were answered, so a stalled service shows up
+        // as timeouts rather than as a lower call rate. Pruned calls never get their callback.
+        auto client = this->create_client<ServiceT>(name, rclcpp::ServicesQoS(), rpc_group_);
+        auto request = std::make_shared<Request>();
+        init_request(*request, rpc_);
+        auto timeout = std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::duration<double>(rpc_.timeout_s));
+        auto period = std::chrono::nanoseconds(static_cast<int64_t>(1e9 / rpc_.rate));
+        rpc_client_ = client;
+        rpc_timer_ = this->create_wall_timer(
+            period,
+            [this, client, request, timeout]() {
+                if (finished_) return;
+                size_t expired = client->prune_requests_older_than(std::chrono::system_clock::now() - timeout);
+                // The request is serialized before async_send_request returns, so it can be stamped and reused
+                int64_t sent = demo::steady_now_ns();
+                stamp_request(*request, sent);
+                using Future = typename rclcpp::Client<ServiceT>::SharedFuture;
+                client->async_send_request(request, [this, sent](Future future) {
+                    int64_t received = demo::steady_now_ns();
+                    bool valid = check_response(*future.get(), sent, rpc_);
+                    std::lock_guard<std::mutex> lock(rpc_mutex_);
+                    if (valid) {
+                        rpc_stats_.record(received - sent);
+                    } else {
+                        rpc_stats_.bad_reply();
+                    }
+                });
+                std::lock_guard<std::mutex> lock(rpc_mutex_);
+                rpc_stats_.timeout(expired);
+            },
+            rpc_group_);
+        RCLCPP_INFO(this->get_logger(), "RPC: calling %s, timeout %.0f ms", demo::describe_rpc(rpc_).c_str(),
+                    rpc_.timeout_s * 1e3);
     }
-    
-    void publish_topic2() {
+
+    void publish_stream(Stream &stream) {
         if (finished_) return;
-        
+
         auto now = std::chrono::steady_clock::now();
         if (duration_ > 0.0) {
             double elapsed = std::chrono::duration<double>(now - start_time_).count();
@@ -232,187 +435,203 @@ private:
                 return;
             }
         }
-        
-        auto msg = create_message(payload2_, 0xB2, msg_id2_++);
-        publisher2_->publish(msg);
-        count2_++;
+
+        auto msg = create_message(stream.base, stream.msg_id++);
+        stream.publisher->publish(msg);
+        stream.count++;
     }
-    
+
     void stop_publishing() {
-        if (!finished_) {
-            finished_ = true;
-            if (timer1_) timer1_->cancel();
-            if (timer2_) timer2_->cancel();
+        if (!finished_.exchange(true)) {
+            for (auto &stream : streams_) {
+                if (stream->timer) stream->timer->cancel();
+            }
             if (status_timer_) status_timer_->cancel();
-            
-            RCLCPP_INFO(this->get_logger(), "Published %zu messages to %s (%.1f Hz, %zu bytes) and %zu messages to %s (%.1f Hz, %zu bytes)",
-                        count1_.load(), topic1_name_.c_str(), rate1_, payload1_, 
-                        count2_.load(), topic2_name_.c_str(), rate2_, payload2_);
-            
+            if (rpc_timer_) rpc_timer_->cancel();
+
+            for (auto &stream : streams_) {
+                RCLCPP_INFO(this->get_logger(), "Published %zu messages to %s (%.1f Hz, %zu bytes)",
+                            stream->count.load(), stream->spec.name.c_str(), stream->spec.rate, stream->spec.payload);
+                if (echo_) {
+                    std::lock_guard<std::mutex> lock(stream->echo_mutex);
+                    RCLCPP_INFO(this->get_logger(), "%zu replies on %s over run: %s", stream->echo_count,
+                                demo::echo_topic(stream->spec.name).c_str(), stream->echo_stats.format_summary().c_str());
+                }
+            }
+
             rclcpp::shutdown();
         }
     }
-    
+
     void stop_subscribing() {
-        if (!finished_) {
-            finished_ = true;
+        if (!finished_.exchange(true)) {
             if (status_timer_) status_timer_->cancel();
-            
-            RCLCPP_INFO(this->get_logger(), "Received %zu messages from %s and %zu messages from %s",
-                        count1_.load(), topic1_name_.c_str(), count2_.load(), topic2_name_.c_str());
-            
+
+            std::string received;
+            for (auto &stream : streams_) {
+                received += (received.empty() ? "" : ", ") + std::to_string(stream->stats.count()) +
+                            " messages from " + stream->spec.name;
+            }
+            RCLCPP_INFO(this->get_logger(), "Received %s", received.c_str());
+
             rclcpp::shutdown();
         }
     }
-    
+
+    void print_rpc_status() {
+        if (rpc_.kind.empty()) return;
+        std::string name = demo::rpc_service_name(rpc_);
+        if (rpc_service_) {
+            size_t served = rpc_served_.load();
+            RCLCPP_INFO(this->get_logger(), "RPC: %s served %zu", name.c_str(), served - rpc_served_last_);
+            rpc_served_last_ = served;
+        } else {
+            std::lock_guard<std::mutex> lock(rpc_mutex_);
+            RCLCPP_INFO(this->get_logger(), "RPC: %s %s", name.c_str(), rpc_stats_.format_status().c_str());
+        }
+    }
+
+    void print_resource_status() {
+        if (resource_monitors_.empty()) return;
+        std::string line;
+        for (auto &monitor : resource_monitors_) {
+            line += (line.empty() ? "" : ", ") + monitor.format_interval();
+        }
+        RCLCPP_INFO(this->get_logger(), "Resources: %s", line.c_str());
+    }
+
     void print_publisher_status() {
         if (finished_) return;
-        
+
         auto now = std::chrono::steady_clock::now();
         auto time_since_status = std::chrono::duration<double>(now - last_status_time_).count();
-        
-        double current_rate1 = (count1_ - count1_last_status_) / time_since_status;
-        double current_rate2 = (count2_ - count2_last_status_) / time_since_status;
-        
-        RCLCPP_INFO(this->get_logger(), "Publishing: %s %zu msgs (%.1f Hz), %s %zu msgs (%.1f Hz)",
-                   topic1_name_.c_str(), count1_.load(), current_rate1,
-                   topic2_name_.c_str(), count2_.load(), current_rate2);
-        
-        count1_last_status_ = count1_;
-        count2_last_status_ = count2_;
+
+        std::string line;
+        for (auto &stream : streams_) {
+            size_t count = stream->count.load();
+            double current_rate = (count - stream->count_last_status) / time_since_status;
+            char buf[256];
+            snprintf(buf, sizeof(buf), "%s %zu msgs (%.1f Hz)", stream->spec.name.c_str(), count, current_rate);
+            line += (line.empty() ? "" : ", ") + std::string(buf);
+            stream->count_last_status = count;
+        }
+        RCLCPP_INFO(this->get_logger(), "Publishing: %s", line.c_str());
+
+        if (echo_) {
+            std::string echo;
+            for (auto &stream : streams_) {
+                std::lock_guard<std::mutex> lock(stream->echo_mutex);
+                echo += (echo.empty() ? "" : ", ") + demo::echo_topic(stream->spec.name) + " " +
+                        stream->echo_stats.format_status();
+            }
+            RCLCPP_INFO(this->get_logger(), "Echo: %s", echo.c_str());
+        }
+        print_rpc_status();
+        print_resource_status();
+
         last_status_time_ = now;
     }
-    
+
     void print_subscriber_status() {
         if (finished_) return;
-        
+
         auto now = std::chrono::steady_clock::now();
         auto time_since_last_display = std::chrono::duration<double>(now - last_status_time_).count();
-        
-        double rate1 = (count1_ - count1_last_status_) / time_since_last_display;
-        double rate2 = (count2_ - count2_last_status_) / time_since_last_display;
-        
-        double avg_latency1 = std::numeric_limits<double>::quiet_NaN();
-        double avg_latency2 = std::numeric_limits<double>::quiet_NaN();
-        uint32_t msgs_with_latency1 = latency_count1_ - latency_count1_last_second_;
-        uint32_t msgs_with_latency2 = latency_count2_ - latency_count2_last_second_;
-        
-        if (msgs_with_latency1 > 0) {
-            avg_latency1 = (latency_sum1_ - latency_sum1_last_second_) / msgs_with_latency1;
-        }
-        if (msgs_with_latency2 > 0) {
-            avg_latency2 = (latency_sum2_ - latency_sum2_last_second_) / msgs_with_latency2;
-        }
-        
-        double loss_rate1, loss_rate2;
-        if (count1_last_status_ == count1_) {
-            loss_rate1 = 100.0;
-        } else {
-            uint32_t total_expected1 = (first_msg1_) ? 0 : last_msg_id1_ - first_msg_id1_;
-            loss_rate1 = (total_expected1 == 0) ? 0.0 : static_cast<double>(missed_events1_) / total_expected1 * 100.0;
-        }
-        
-        if (count2_last_status_ == count2_) {
-            loss_rate2 = 100.0;
-        } else {
-            uint32_t total_expected2 = (first_msg2_) ? 0 : last_msg_id2_ - first_msg_id2_;
-            loss_rate2 = (total_expected2 == 0) ? 0.0 : static_cast<double>(missed_events2_) / total_expected2 * 100.0;
+
+        std::ostringstream line;
+        for (auto &stream : streams_) {
+            size_t count = stream->stats.count();
+            double rate = (count - stream->count_last_status) / time_since_last_display;
+            demo::SequenceStats sequence = stream->sequence_snapshot.load();
+            stream->stats.drain_latency(stream->latency);
+
+            // Nothing arrived at all in this interval, so there is no id to measure a gap against
+            std::string loss = (stream->count_last_status == count)
+                                   ? "loss: 100.00%"
+                                   : demo::format_loss(sequence - stream->sequence_last_second);
+
+            if (line.tellp() > 0) line << ", ";
+            line << stream->spec.name << ": " << format_bytes(stream->stats.payload_size()) << ", " << std::fixed
+                 << std::setprecision(1) << rate << " Hz, " << demo::format_latency_ms(stream->latency) << ", " << loss;
+
+            stream->count_last_status = count;
+            stream->sequence_last_second = sequence;
+            stream->latency_total.merge(stream->latency);
+            stream->latency.reset();
         }
-        
-        std::cout << topic1_name_ << ": " << format_bytes(payload_size1_) << ", " << std::fixed << std::setprecision(1) << rate1 << " Hz, "
-                  << std::setprecision(2) << avg_latency1 << " ms, "
-                  << "loss: " << std::setprecision(2) << loss_rate1 << "%, "
-                  << topic2_name_ << ": " << format_bytes(payload_size2_) << ", " << std::setprecision(1) << rate2 << " Hz, "
-                  << std::setprecision(2) << avg_latency2 << " ms, "
-                  << "loss: " << std::setprecision(2) << loss_rate2 << "%" << std::endl;
-        
-        count1_last_status_ = count1_;
-        count2_last_status_ = count2_;
-        latency_sum1_last_second_ = latency_sum1_;
-        latency_sum2_last_second_ = latency_sum2_;
-        latency_count1_last_second_ = latency_count1_;
-        latency_count2_last_second_ = latency_count2_;
+        std::cout << line.str() << std::endl;
+        print_rpc_status();
+        print_resource_status();
+
         last_status_time_ = now;
     }
-    
-    void subscription1_callback(const std_msgs::msg::UInt8MultiArray::SharedPtr msg) {
-        count1_++;
-        payload_size1_ = msg->data.size();
-        
-        if (msg->data.size() >= sizeof(uint32_t)) {
+
+    void on_message(Stream &stream, const std_msgs::msg::UInt8MultiArray &msg) {
+        demo::StatsShard &shard = stream.stats.local();
+        shard.count.fetch_add(1, std::memory_order_relaxed);
+        shard.payload_size.store(msg.data.size(), std::memory_order_relaxed);
+
+        if (msg.data.size() >= sizeof(uint32_t)) {
             uint32_t msg_id;
-            std::memcpy(&msg_id, msg->data.data(), sizeof(uint32_t));
-            if (first_msg1_) {
-                first_msg_id1_ = msg_id;
-                last_msg_id1_ = msg_id;
-                first_msg1_ = false;
-            } else {
-                if (msg_id > last_msg_id1_ + 1) {
-                    missed_events1_++;
-                }
-                last_msg_id1_ = msg_id;
-            }
+            std::memcpy(&msg_id, msg.data.data(), sizeof(uint32_t));
+            stream.sequence.record(msg_id);
+            stream.sequence_snapshot.store(stream.sequence.stats());
         }
-        
-        if (msg->data.size() >= sizeof(uint32_t) + sizeof(int64_t)) {
+
+        if (msg.data.size() >= sizeof(uint32_t) + sizeof(int64_t)) {
             int64_t send_timestamp;
-            std::memcpy(&send_timestamp, msg->data.data() + sizeof(uint32_t), sizeof(int64_t));
+            std::memcpy(&send_timestamp, msg.data.data() + sizeof(uint32_t), sizeof(int64_t));
             auto recv_timestamp = std::chrono::steady_clock::now().time_since_epoch().count();
-            double latency_ms = (recv_timestamp - send_timestamp) / 1e6;
-            latency_sum1_ += latency_ms;
-            latency_count1_++;
-        }
-    }
-    
-    void subscription2_callback(const std_msgs::msg::UInt8MultiArray::SharedPtr msg) {
-        count2_++;
-        payload_size2_ = msg->data.size();
-        
-        if (msg->data.size() >= sizeof(uint32_t)) {
-            uint32_t msg_id;
-            std::memcpy(&msg_id, msg->data.data(), sizeof(uint32_t));
-            if (first_msg2_) {
-                first_msg_id2_ = msg_id;
-                last_msg_id2_ = msg_id;
-                first_msg2_ = false;
-            } else {
-                if (msg_id > last_msg_id2_ + 1) {
-                    missed_events2_++;
-                }
-                last_msg_id2_ = msg_id;
+            shard.latency.record(recv_timestamp - send_timestamp);
+
+            if (stream.echo_publisher) {
+                demo::write_echo_reply(stream.echo_reply.data.data(), msg.data.data(), msg.data.size(), recv_timestamp,
+                                       demo::steady_now_ns());
+                stream.echo_publisher->publish(stream.echo_reply);
             }
         }
-        
-        if (msg->data.size() >= sizeof(uint32_t) + sizeof(int64_t)) {
-            int64_t send_timestamp;
-            std::memcpy(&send_timestamp, msg->data.data() + sizeof(uint32_t), sizeof(int64_t));
-            auto recv_timestamp = std::chrono::steady_clock::now().time_since_epoch().count();
-            double latency_ms = (recv_timestamp - send_timestamp) / 1e6;
-            latency_sum2_ += latency_ms;
-            latency_count2_++;
+    }
+
+    void on_echo(Stream &stream, const std_msgs::msg::UInt8MultiArray &msg) {
+        int64_t t4 = demo::steady_now_ns();
+        demo::EchoTimestamps ts;
+        if (demo::read_echo_reply(msg.data.data(), msg.data.size(), ts)) {
+            std::lock_guard<std::mutex> lock(stream.echo_mutex);
+            stream.echo_count++;
+            stream.echo_stats.record(ts, t4);
         }
     }
 };
 
 void print_help(const char *program) {
     std::cout << "Usage: " << program
-              << " [--mode pub|sub|parallel_pub] [--topic1 <name>] [--topic2 <name>] [--duration <sec>] [--rate1 <Hz>] [--rate2 <Hz>] [--payload1 <bytes>] [--payload2 <bytes>] [--threads <count>] [--help]\n";
+              << " [--mode pub|sub|parallel_pub] [--stream <name>:<Hz>:<bytes>[:<qos>]]... [--topic1 <name>] [--topic2 <name>] [--duration <sec>] [--rate1 <Hz>] [--rate2 <Hz>] [--payload1 <bytes>] [--payload2 <bytes>] [--executor single|multi|static_single|events] [--threads <count>] [--callback-groups per_topic|default] [--qos <name>:<qos>]... [--content <name>:<content>]... [--echo] [--resources] [--rpc <service>] [--rpc-rate <Hz>] [--rpc-timeout <ms>] [--help]\n"
+              << "  --stream can be repeated and replaces the --topic/--rate/--payload pairs\n"
+              << "  <qos> is <preset>[,<key>=<value>]..., <preset> is one of " << demo::kQosPresets
+              << " and the settings are " << demo::kQosSettings << "\n"
+              << "  --content sets what a stream's payload holds, <content> is one of " << demo::kPayloadContents << "\n"
+              << "  --threads sizes the multi executor, which is also the default when it is above 1; without it, or\n"
+              << "  with 0, the multi executor uses every hardware thread\n"
+              << "  --callback-groups per_topic gives every stream and the status timers their own group\n"
+              << "  --echo makes subscribers reply on <name>/echo and publishers report round trips; set it on both sides\n"
+              << "  --resources logs CPU, context switches, page faults and RSS of this process and a local rmw_zenohd\n"
+              << "  --rpc serves a service in sub mode and calls it at --rpc-rate otherwise, and reports round trips\n"
+              << "  and calls unanswered within --rpc-timeout; <service> is one of " << demo::kRpcKinds << "\n";
 }
 
-bool parse_args(int argc, char *argv[], std::string &mode, std::string &topic1_name, std::string &topic2_name,
-                double &duration, double &rate1, double &rate2, std::size_t &payload1, std::size_t &payload2, int &num_threads) {
-    mode = "sub";
-    topic1_name = "topic_1";
-    topic2_name = "topic_2";
-    duration = 3.0;
-    rate1 = 1.0;
-    rate2 = 2.0;
-    payload1 = 20;
-    payload2 = 40;
-    num_threads = 1;
+bool parse_args(int argc, char *argv[], Options &opts) {
+    std::string topic1_name = "topic_1";
+    std::string topic2_name = "topic_2";
+    double rate1 = 1.0;
+    double rate2 = 2.0;
+    std::size_t payload1 = 20;
+    std::size_t payload2 = 40;
+    std::vector<std::string> qos;
+    std::vector<std::string> content;
 
     const struct option long_options[] = {
         {"mode", required_argument, nullptr, 'm'},
+        {"stream", required_argument, nullptr, 's'},
         {"topic1", required_argument, nullptr, '1'},
         {"topic2", required_argument, nullptr, '2'},
         {"duration", required_argument, nullptr, 'd'},
@@ -420,17 +639,36 @@ bool parse_args(int argc, char *argv[], std::string &mode, std::string &topic1_n
         {"rate2", required_argument, nullptr, 'R'},
         {"payload1", required_argument, nullptr, 'p'},
         {"payload2", required_argument, nullptr, 'P'},
+        {"executor", required_argument, nullptr, 'x'},
         {"threads", required_argument, nullptr, 't'},
+        {"callback-groups", required_argument, nullptr, 'g'},
+        {"qos", required_argument, nullptr, 'q'},
+        {"content", required_argument, nullptr, 'c'},
+        {"echo", no_argument, nullptr, 'e'},
+        {"resources", no_argument, nullptr, 'u'},
+        {"rpc", required_argument, nullptr, 'v'},
+        {"rpc-rate", required_argument, nullptr, 'V'},
+        {"rpc-timeout", required_argument, nullptr, 'T'},
         {"help", no_argument, nullptr, 'h'},
         {nullptr, 0, nullptr, 0}
     };
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "m:1:2:d:r:R:p:P:t:h", long_options, nullptr)) != -1) {
+    std::string error;
+    while ((opt = getopt_long(argc, argv, "m:s:1:2:d:r:R:p:P:x:t:g:q:c:euv:V:T:h", long_options, nullptr)) != -1) {
         switch (opt) {
             case 'm':
-                mode = optarg;
+                opts.mode = optarg;
                 break;
+            case 's': {
+                demo::StreamSpec spec;
+                if (!demo::parse_stream_spec(optarg, spec, error)) {
+                    std::cerr << "Invalid --stream: " << error << "\n";
+                    return false;
+                }
+                opts.streams.push_back(spec);
+                break;
+            }
             case '1':
                 topic1_name = optarg;
                 break;
@@ -438,7 +676,7 @@ bool parse_args(int argc, char *argv[], std::string &mode, std::string &topic1_n
                 topic2_name = optarg;
                 break;
             case 'd':
-                duration = std::stod(optarg);
+                opts.duration = std::stod(optarg);
                 break;
             case 'r':
                 rate1 = std::stod(optarg);
@@ -452,9 +690,38 @@ bool parse_args(int argc, char *argv[], std::string &mode, std::string &topic1_n
             case 'P':
                 payload2 = static_cast<std::size_t>(std::stoul(optarg));
                 break;
+            case 'x':
+                opts.executor = optarg;
+                break;
             case 't':
-                num_threads = std::atoi(optarg);
-                if (num_threads <= 0) num_threads = 1;
+                opts.num_threads = std::max(std::atoi(optarg), 0);
+                break;
+            case 'g':
+                opts.callback_groups = optarg;
+                break;
+            case 'q':
+                qos.push_back(optarg);
+                break;
+            case 'c':
+                content.push_back(optarg);
+                break;
+            case 'e':
+                opts.echo = true;
+                break;
+            case 'u':
+                opts.resources = true;
+                break;
+            case 'v':
+                if (!demo::parse_rpc_spec(optarg, opts.rpc, error)) {
+                    std::cerr << "Invalid --rpc: " << error << "\n";
+                    return false;
+                }
+                break;
+            case 'V':
+                opts.rpc.rate = std::stod(optarg);
+                break;
+            case 'T':
+                opts.rpc.timeout_s = std::stod(optarg) / 1e3;
                 break;
             case 'h':
                 print_help(argv[0]);
@@ -466,39 +733,112 @@ bool parse_args(int argc, char *argv[], std::string &mode, std::string &topic1_n
         }
     }
 
-    if (mode != "pub" && mode != "sub" && mode != "parallel_pub") {
+    if (opts.mode != "pub" && opts.mode != "sub" && opts.mode != "parallel_pub") {
         std::cerr << "Invalid --mode\n";
         return false;
     }
+    if (opts.executor.empty()) {
+        opts.executor = opts.num_threads > 1 ? "multi" : "single";
+    } else if (opts.executor != "single" && opts.executor != "multi" && opts.executor != "static_single" &&
+               opts.executor != "events") {
+        std::cerr << "Invalid --executor\n";
+        return false;
+    }
+    if (opts.executor != "multi") {
+        opts.num_threads = 1;
+    } else if (opts.num_threads == 0) {
+        // A one-thread MultiThreadedExecutor is only a slower single executor
+        opts.num_threads = std::max(static_cast<int>(std::thread::hardware_concurrency()), 2);
+    }
+    if (opts.callback_groups != "per_topic" && opts.callback_groups != "default") {
+        std::cerr << "Invalid --callback-groups\n";
+        return false;
+    }
+    if (opts.rpc.rate <= 0.0 || opts.rpc.timeout_s <= 0.0) {
+        std::cerr << "Invalid --rpc-rate or --rpc-timeout\n";
+        return false;
+    }
+
+    // Without --stream, fall back to the classic small/large topic pair
+    if (opts.streams.empty()) {
+        demo::StreamSpec stream1, stream2;
+        stream1.name = topic1_name;
+        stream1.rate = rate1;
+        stream1.payload = payload1;
+        stream2.name = topic2_name;
+        stream2.rate = rate2;
+        stream2.payload = payload2;
+        opts.streams = {stream1, stream2};
+    }
+    if (!demo::finalize_streams(opts.streams, error)) {
+        std::cerr << "Invalid --stream: " << error << "\n";
+        return false;
+    }
+
+    for (const auto &item : qos) {
+        std::string value;
+        demo::StreamSpec *stream = demo::find_stream_option(opts.streams, item, value);
+        rmw_qos_profile_t profile;
+        if (!stream) {
+            std::cerr << "Invalid --qos: expected <name>:<qos> naming a stream, got '" << item << "'\n";
+            return false;
+        } else if (!demo::parse_qos(value, profile, error)) {
+            std::cerr << "Invalid --qos: " << error << "\n";
+            return false;
+        }
+        stream->qos = value;
+    }
+    for (const auto &item : content) {
+        std::string value;
+        demo::StreamSpec *stream = demo::find_stream_option(opts.streams, item, value);
+        if (!stream) {
+            std::cerr << "Invalid --content: expected <name>:<content> naming a stream, got '" << item << "'\n";
+            return false;
+        } else if (!demo::parse_payload_content(value, error)) {
+            std::cerr << "Invalid --content: " << error << "\n";
+            return false;
+        }
+        stream->content = value;
+    }
     return true;
 }
 
-int main(int argc, char *argv[]) {
-    std::string mode, topic1_name, topic2_name;
-    double duration, rate1, rate2;
-    std::size_t payload1, payload2;
-    int num_threads;
+std::unique_ptr<rclcpp::Executor> make_executor(const Options &opts) {
+    if (opts.executor == "multi") {
+        std::cout << "Using MultiThreadedExecutor (" << opts.num_threads << " threads)" << std::endl;
+        return std::make_unique<rclcpp::executors::MultiThreadedExecutor>(rclcpp::ExecutorOptions(),
+                                                                          opts.num_threads);
+    } else if (opts.executor == "static_single") {
+        std::cout << "Using StaticSingleThreadedExecutor (1 thread)" << std::endl;
+        // Deprecated on rolling in favour of the single executor, but still the baseline it is compared against
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+        return std::make_unique<rclcpp::executors::StaticSingleThreadedExecutor>();
+#pragma GCC diagnostic pop
+    } else if (opts.executor == "events") {
+        std::cout << "Using EventsExecutor (1 thread)" << std::endl;
+        return std::make_unique<rclcpp::experimental::executors::EventsExecutor>();
+    }
+    std::cout << "Using SingleThreadedExecutor (1 thread)" << std::endl;
+    return std::make_unique<rclcpp::executors::SingleThreadedExecutor>();
+}
 
-    if (!parse_args(argc, argv, mode, topic1_name, topic2_name, duration, rate1, rate2, payload1, payload2, num_threads)) {
+int main(int argc, char *argv[]) {
+    Options opts;
+    if (!parse_args(argc, argv, opts)) {
         return 1;
     }
 
     rclcpp::init(argc, argv);
 
-    auto node = std::make_shared<DualPubSubNode>(mode, topic1_name, topic2_name, duration, rate1, rate2, payload1, payload2);
-
-    if (num_threads <= 1) {
-        std::cout << "Using SingleThreadedExecutor (1 thread)" << std::endl;
-        rclcpp::executors::SingleThreadedExecutor executor;
-        executor.add_node(node);
-        executor.spin();
-    } else {
-        std::cout << "Using MultiThreadedExecutor (" << num_threads << " threads)" << std::endl;
-        rclcpp::executors::MultiThreadedExecutor executor(rclcpp::ExecutorOptions(), num_threads);
-        executor.add_node(node);
-        executor.spin();
-    }
+    auto node = std::make_shared<DualPubSubNode>(opts);
+    std::unique_ptr<rclcpp::Executor> executor = make_executor(opts);
+    executor->add_node(node);
+    executor->spin();
 
+    node->print_subscriber_summary();
+    node->print_rpc_summary();
+    node->print_resource_summary();
     rclcpp::shutdown();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,129 @@
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "demo/trace_file.hpp"
+
+// Offline converter for the --trace-out files written by dual_pubsub. Needs no ROS at all.
+
+void print_help(const char *program) {
+    std::cout << "Usage: " << program << " <trace file> [--format csv|columns] [--out <path>] [--help]\n"
+              << "  csv writes one row per record to <path> (default stdout)\n"
+              << "  columns writes each field as a raw little-endian array <path>/<field>.<type> plus\n"
+              << "  <path>/streams.txt, e.g. for numpy.fromfile\n";
+}
+
+// Subscriber traces carry both timestamps; publisher traces have no receive time and no latency
+int64_t latency_ns(const demo::TraceRecord &record) { return record.recv_ns ? record.recv_ns - record.send_ns : 0; }
+
+bool write_csv(const demo::TraceReader &reader, std::ostream &out) {
+    const auto &names = reader.stream_names();
+    out << "stream,topic,msg_id,send_ns,recv_ns,latency_ns,size,duration_ns\n";
+    for (uint64_t i = 0; i < reader.size(); ++i) {
+        const demo::TraceRecord &record = reader.at(i);
+        out << record.stream << ',' << (record.stream < names.size() ? names[record.stream] : "") << ','
+            << record.msg_id << ',' << record.send_ns << ',' << record.recv_ns << ',' << latency_ns(record) << ','
+            << record.size << ',' << record.duration_ns << '\n';
+    }
+    out.flush();
+    return static_cast<bool>(out);
+}
+
+template <typename T>
+bool write_column(const demo::TraceReader &reader, const std::string &path,
+                  const std::function<T(const demo::TraceRecord &)> &field) {
+    std::vector<T> column(reader.size());
+    for (uint64_t i = 0; i < reader.size(); ++i) {
+        column[i] = field(reader.at(i));
+    }
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Cannot create " << path << ": " << strerror(errno) << "\n";
+        return false;
+    }
+    bool ok = fwrite(column.data(), sizeof(T), column.size(), file) == column.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok) std::cerr << "Failed to write " << path << "\n";
+    return ok;
+}
+
+bool write_columns(const demo::TraceReader &reader, const std::string &dir) {
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "Cannot create " << dir << ": " << strerror(errno) << "\n";
+        return false;
+    }
+    std::ofstream streams(dir + "/streams.txt");
+    for (const auto &name : reader.stream_names()) {
+        streams << name << "\n";
+    }
+    using Record = demo::TraceRecord;
+    return static_cast<bool>(streams) &&
+           write_column<uint32_t>(reader, dir + "/stream.u32", [](const Record &r) { return r.stream; }) &&
+           write_column<uint32_t>(reader, dir + "/msg_id.u32", [](const Record &r) { return r.msg_id; }) &&
+           write_column<int64_t>(reader, dir + "/send_ns.i64", [](const Record &r) { return r.send_ns; }) &&
+           write_column<int64_t>(reader, dir + "/recv_ns.i64", [](const Record &r) { return r.recv_ns; }) &&
+           write_column<int64_t>(reader, dir + "/latency_ns.i64", [](const Record &r) { return latency_ns(r); }) &&
+           write_column<uint32_t>(reader, dir + "/size.u32", [](const Record &r) { return r.size; }) &&
+           write_column<int64_t>(reader, dir + "/duration_ns.i64", [](const Record &r) { return r.duration_ns; });
+}
+
+int main(int argc, char *argv[]) {
+    std::string input;
+    std::string format = "csv";
+    std::string out;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help") {
+            print_help(argv[0]);
+            return 0;
+        } else if (arg == "--format" && i + 1 < argc) {
+            format = argv[++i];
+        } else if (arg == "--out" && i + 1 < argc) {
+            out = argv[++i];
+        } else if (input.empty() && arg.compare(0, 2, "--") != 0) {
+            input = arg;
+        } else {
+            std::cerr << "Unknown arg: " << arg << "\n";
+            print_help(argv[0]);
+            return 1;
+        }
+    }
+    if (input.empty() || (format != "csv" && format != "columns") || (format == "columns" && out.empty())) {
+        print_help(argv[0]);
+        return 1;
+    }
+
+    demo::TraceReader reader;
+    std::string error;
+    if (!reader.open(input, error)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    if (reader.written() > reader.size()) {
+        std::cerr << "Ring wrapped, keeping the last " << reader.size() << " of " << reader.written() << " records\n";
+    }
+
+    bool ok;
+    if (format == "columns") {
+        ok = write_columns(reader, out);
+    } else if (out.empty()) {
+        ok = write_csv(reader, std::cout);
+    } else {
+        std::ofstream file(out);
+        ok = write_csv(reader, file);
+    }
+    if (!ok) {
+        std::cerr << "Failed to write " << (out.empty() ? "output" : out) << "\n";
+        return 1;
+    }
+    std::cerr << "Converted " << reader.size() << " " << reader.role() << " records\n";
+    return 0;
+}